@@ -0,0 +1,467 @@
+/**
+ *
+ * Microbenchmarks of the tracking hot paths.
+ *
+ * Runs synthetic frames of several resolutions, and optionally the frames
+ * of a recording, through the individual stages and prints the time and
+ * the number of heap allocations per frame of each.
+ *
+ * Usage: bench [--iterations n] [--recording file] [--cascade file]
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <malloc.h>
+#include <math.h>
+#include <new>
+#include <vector>
+
+#include <QImage>
+
+#include "headtracker.hpp"
+#include "headtrackfilter.hpp"
+#include "headposition.hpp"
+#include "kalman.hpp"
+#include "reorient.hpp"
+#include "headregistration.hpp"
+#include "posefusion.hpp"
+#include "temporalfilter.hpp"
+#include "preview.hpp"
+#include "timestamp.hpp"
+#include "framefile.hpp"
+
+// Count every heap allocation of the process, including the ones OpenCV
+// makes through malloc. Relies on glibc exporting __libc_malloc and friends.
+
+extern "C"
+{
+  void *__libc_malloc (size_t size);
+  void *__libc_calloc (size_t n, size_t size);
+  void *__libc_realloc (void *p, size_t size);
+  void *__libc_memalign (size_t alignment, size_t size);
+}
+
+static volatile unsigned long s_allocations = 0;
+
+// Dynamic exception specifications are deprecated since C++11 and gone in
+// C++17, so the replacements only use them for older standards
+#if __cplusplus >= 201103L
+#define BENCH_THROWS_BAD_ALLOC noexcept (false)
+#define BENCH_NOTHROW noexcept
+#else
+#define BENCH_THROWS_BAD_ALLOC throw (std::bad_alloc)
+#define BENCH_NOTHROW throw ()
+#endif
+
+extern "C" void *malloc (size_t size) BENCH_NOTHROW
+{
+  __sync_fetch_and_add (&s_allocations, 1);
+  return __libc_malloc (size);
+}
+
+extern "C" void *calloc (size_t n, size_t size) BENCH_NOTHROW
+{
+  __sync_fetch_and_add (&s_allocations, 1);
+  return __libc_calloc (n, size);
+}
+
+extern "C" void *realloc (void *p, size_t size) BENCH_NOTHROW
+{
+  __sync_fetch_and_add (&s_allocations, 1);
+  return __libc_realloc (p, size);
+}
+
+extern "C" int posix_memalign (void **p, size_t alignment, size_t size) BENCH_NOTHROW
+{
+  __sync_fetch_and_add (&s_allocations, 1);
+  *p = __libc_memalign (alignment, size);
+  return *p ? 0 : ENOMEM;
+}
+
+void *operator new (size_t size) BENCH_THROWS_BAD_ALLOC
+{
+  void *p = malloc (size);
+  if (!p)
+    {
+      throw std::bad_alloc ();
+    }
+  return p;
+}
+
+void *operator new[] (size_t size) BENCH_THROWS_BAD_ALLOC
+{
+  return operator new (size);
+}
+
+void operator delete (void *p) BENCH_NOTHROW
+{
+  free (p);
+}
+
+void operator delete[] (void *p) BENCH_NOTHROW
+{
+  free (p);
+}
+
+// With sized deallocation the compiler may call these instead
+#ifdef __cpp_sized_deallocation
+void operator delete (void *p, size_t) noexcept
+{
+  free (p);
+}
+
+void operator delete[] (void *p, size_t) noexcept
+{
+  free (p);
+}
+#endif
+
+/** One frame in sensor order */
+struct BenchFrame
+{
+  PMDDataDescription dd;
+  std::vector < float >amplitudes;
+  std::vector < float >coordinates;
+  std::vector < unsigned >flags;
+};
+
+/** Frame with a bright, near ellipse as head on neck and shoulders in front
+ * of a wall at 2 m */
+static void makeSyntheticFrame (unsigned columns, unsigned rows, BenchFrame & frame)
+{
+  memset (&frame.dd, 0, sizeof (frame.dd));
+  frame.dd.subHeaderType = PMD_IMAGE_DATA;
+  frame.dd.img.numColumns = columns;
+  frame.dd.img.numRows = rows;
+  frame.dd.img.pixelOrigin = PMD_ORIGIN_BOTTOM_LEFT;
+
+  frame.amplitudes.resize (rows * columns);
+  frame.coordinates.resize (rows * columns * 3);
+  frame.flags.assign (rows * columns, 0);
+
+  // Roughly the field of view of the CamBoard nano
+  float focal = columns * 0.9f;
+  float cx = columns / 2.0f, cy = rows / 2.0f;
+  float rx = columns / 10.0f, ry = rows / 6.0f;
+
+  srand (1);
+
+  for (unsigned v = 0; v < rows; ++v)
+    {
+      for (unsigned u = 0; u < columns; ++u)
+        {
+          unsigned idx = v * columns + u;
+          float dx = (u - cx) / rx, dy = (v - cy) / ry;
+          bool head = dx * dx + dy * dy < 1.0f;
+          bool neck = dy >= 1.0f && dy < 1.3f && fabsf (dx) < 0.6f;
+          bool body = dy >= 1.3f && fabsf (dx) < 2.8f;
+          float z = head ? 0.8f + 0.05f * (dx * dx + dy * dy) : (neck || body) ? 0.9f : 2.0f;
+          float noise = (rand () % 1000) / 1000.0f;
+
+          frame.amplitudes[idx] = (head ? 1500.0f : 200.0f) + 50.0f * noise;
+          frame.coordinates[idx * 3 + 0] = (u - cx) * z / focal;
+          frame.coordinates[idx * 3 + 1] = (v - cy) * z / focal;
+          frame.coordinates[idx * 3 + 2] = z + 0.005f * noise;
+        }
+    }
+}
+
+/** Time and allocation count of one benchmark */
+struct Measurement
+{
+  uint64_t start;
+  unsigned long allocations;
+};
+
+static inline void begin (Measurement & m)
+{
+  m.allocations = s_allocations;
+  m.start = monotonicNanoseconds ();
+}
+
+static inline void end (Measurement & m, const char *name, unsigned columns, unsigned rows, unsigned iterations)
+{
+  uint64_t ns = monotonicNanoseconds () - m.start;
+  unsigned long allocations = s_allocations - m.allocations;
+
+  printf ("%-28s %4ux%-4u %12.0f ns/frame %8.2f allocs/frame\n", name, columns, rows,
+          (double) ns / iterations, (double) allocations / iterations);
+}
+
+static void runBenchmarks (const BenchFrame & frame, const char *cascade, unsigned iterations)
+{
+  unsigned rows = frame.dd.img.numRows;
+  unsigned columns = frame.dd.img.numColumns;
+  unsigned origin = frame.dd.img.pixelOrigin;
+  unsigned pixels = rows * columns;
+
+  const float *amps = &frame.amplitudes[0];
+  const float *coords = &frame.coordinates[0];
+  const unsigned *flags = &frame.flags[0];
+
+  std::vector < float >outAmps (pixels), outCoords (pixels * 3);
+  std::vector < unsigned >outFlags (pixels);
+
+  Measurement m;
+  float max = 0.0f;
+
+  // Reorientation
+  begin (m);
+  for (unsigned i = 0; i < iterations; ++i)
+    {
+      reorientBuffers (origin, rows, columns, amps, coords, flags, &outAmps[0], &outCoords[0], &outFlags[0], max);
+    }
+  end (m, "reorient", columns, rows, iterations);
+
+  begin (m);
+  for (unsigned i = 0; i < iterations; ++i)
+    {
+      reorientBuffers (origin, rows, columns, amps, NULL, NULL, &outAmps[0], NULL, NULL, max);
+    }
+  end (m, "reorient amplitudes only", columns, rows, iterations);
+
+  unsigned width = ((origin & 0xffff0000) == PMD_DIRECTION_VERTICAL) ? rows : columns;
+  unsigned height = pixels / width;
+
+  Mat gray (height, width, CV_8UC1);
+
+  begin (m);
+  for (unsigned i = 0; i < iterations; ++i)
+    {
+      amplitudesToGray (&outAmps[0], width, height, max, gray.data, gray.step);
+    }
+  end (m, "gray image", columns, rows, iterations);
+
+  // On copies, the later stages get the buffers as reoriented
+  TemporalFilter temporal;
+  std::vector < float >filteredAmps (outAmps), filteredCoords (outCoords);
+
+  begin (m);
+  for (unsigned i = 0; i < iterations; ++i)
+    {
+      temporal.filter (&filteredAmps[0], &filteredCoords[0], &outFlags[0], pixels);
+    }
+  end (m, "TemporalFilter", columns, rows, iterations);
+
+  // Face finding, both detectors and both branches
+  HeadTrackFilter filter (cascade);
+  int left, top, w, h, faceX, faceY;
+
+  filter.setDetectionMode (HeadTrackFilter::DETECT_HAAR);
+
+  begin (m);
+  for (unsigned i = 0; i < iterations; ++i)
+    {
+      filter.resetHead ();
+      filter.findFace (gray, left, top, w, h, faceX, faceY);
+    }
+  end (m, "findFace detect", columns, rows, iterations);
+
+  filter.setDetectionMode (HeadTrackFilter::DETECT_DEPTH);
+  filter.setPoints (&outCoords[0], &outFlags[0]);
+
+  begin (m);
+  for (unsigned i = 0; i < iterations; ++i)
+    {
+      filter.resetHead ();
+      filter.findFace (gray, left, top, w, h, faceX, faceY);
+    }
+  end (m, "findFace detect depth", columns, rows, iterations);
+
+  filter.setDetectionMode (HeadTrackFilter::DETECT_HAAR_GUIDED);
+
+  begin (m);
+  for (unsigned i = 0; i < iterations; ++i)
+    {
+      filter.resetHead ();
+      filter.findFace (gray, left, top, w, h, faceX, faceY);
+    }
+  end (m, "findFace detect guided", columns, rows, iterations);
+
+  Rect face (width * 2 / 5, height / 3, width / 5, height / 3);
+
+  filter.setSearchWindow (false);
+  filter.startTracking (gray, face);
+
+  begin (m);
+  for (unsigned i = 0; i < iterations; ++i)
+    {
+      filter.findFace (gray, left, top, w, h, faceX, faceY);
+    }
+  end (m, "findFace match full", columns, rows, iterations);
+
+  filter.setSearchWindow (true);
+  filter.startTracking (gray, face);
+
+  begin (m);
+  for (unsigned i = 0; i < iterations; ++i)
+    {
+      filter.findFace (gray, left, top, w, h, faceX, faceY);
+    }
+  end (m, "findFace match window", columns, rows, iterations);
+
+  // Position and smoothing on a fully processed frame
+  HeadTracker tracker (cascade);
+  HeadPose pose;
+
+  tracker.setFormat (rows, columns, origin);
+  tracker.process (amps, coords, flags, 0, 0, pose);
+
+  // What HeadTracker::getCoords and filterPosition run, on the same frame
+  float position[3] = { 0.0f, 0.0f, 0.0f };
+
+  begin (m);
+  for (unsigned i = 0; i < iterations; ++i)
+    {
+      estimateHeadPosition (tracker.amplitudes (), tracker.coordinates (), tracker.flags (), width, height,
+                            face.x, face.y, face.width, face.height, position);
+    }
+  end (m, "getCoords", columns, rows, iterations);
+
+  // The first update starts the model, the others register against it
+  HeadRegistration registration;
+  float center[3];
+  memcpy (center, tracker.coordinates () + ((face.y + face.height / 2) * width + face.x + face.width / 2) * 3,
+          sizeof (center));
+
+  begin (m);
+  for (unsigned i = 0; i < iterations; ++i)
+    {
+      registration.update (tracker.coordinates (), tracker.flags (), width, height,
+                           face.x, face.y, face.width, face.height, center);
+    }
+  end (m, "HeadRegistration::update", columns, rows, iterations);
+
+  // Set up like the constant velocity filter of HeadTracker
+  KalmanFilter < 6, 3 > kalman;
+  setConstantVelocity < 3 > (kalman, 1.0f);
+  kalman.setCovariances (1e-3f * 1e-6f, 5e+1f * 1e-6f, 1e-6f);
+
+  begin (m);
+  for (unsigned i = 0; i < iterations; ++i)
+    {
+      kalman.predict ();
+      kalman.correct (position);
+    }
+  end (m, "Kalman", columns, rows, iterations);
+
+  begin (m);
+  for (unsigned i = 0; i < iterations; ++i)
+    {
+      tracker.process (amps, coords, flags, 0, i, pose);
+    }
+  end (m, "HeadTracker::process", columns, rows, iterations);
+
+  // Three cameras taking turns, as the fusion stage sees them
+  PoseFusion fusion (3);
+  HeadPose fused;
+
+  begin (m);
+  for (unsigned i = 0; i < iterations; ++i)
+    {
+      pose.timestampUs = 1000 + i * 11111;
+      fusion.update (i % 3, pose, fused);
+    }
+  end (m, "PoseFusion::update", columns, rows, iterations);
+
+  // The paint of PreviewWidget, into an image of the widget's size instead
+  // of the backing store, which needs a display
+  FrameSlot slot;
+  memset (&slot.pose, 0, sizeof (slot.pose));
+  slot.pose.state = 2;
+  slot.pose.faceLeft = face.x;
+  slot.pose.faceTop = face.y;
+  slot.pose.faceWidth = face.width;
+  slot.pose.faceHeight = face.height;
+  slot.gray = gray.data;
+  slot.grayWidth = gray.cols;
+  slot.grayHeight = gray.rows;
+
+  QImage preview (gray.cols, gray.rows, QImage::Format_RGB32);
+
+  begin (m);
+  for (unsigned i = 0; i < iterations; ++i)
+    {
+      QPainter painter (&preview);
+      drawPreview (painter, slot, previewImage (slot));
+    }
+  end (m, "preview", columns, rows, iterations);
+
+  printf ("\n");
+}
+
+int main (int argc, char *argv[])
+{
+  unsigned iterations = 200;
+  const char *recording = NULL;
+  const char *cascade = "haarcascade_frontalface_alt.xml";
+
+  for (int i = 1; i < argc; ++i)
+    {
+      if (!strcmp (argv[i], "--iterations") && i + 1 < argc)
+        {
+          iterations = atoi (argv[++i]);
+        }
+      else if (!strcmp (argv[i], "--recording") && i + 1 < argc)
+        {
+          recording = argv[++i];
+        }
+      else if (!strcmp (argv[i], "--cascade") && i + 1 < argc)
+        {
+          cascade = argv[++i];
+        }
+    }
+
+  if (!iterations)
+    {
+      iterations = 1;
+    }
+
+  static const unsigned resolutions[][2] = {
+    {160, 120},                 // CamBoard nano
+    {176, 144},
+    {200, 200},
+    {320, 240},
+    {352, 288},
+    {640, 480}
+  };
+
+  for (unsigned r = 0; r < sizeof (resolutions) / sizeof (resolutions[0]); ++r)
+    {
+      BenchFrame frame;
+      makeSyntheticFrame (resolutions[r][0], resolutions[r][1], frame);
+      runBenchmarks (frame, cascade, iterations);
+    }
+
+  if (recording)
+    {
+      FrameFile file;
+      if (!file.open (recording))
+        {
+          fprintf (stderr, "Could not open recording %s\n", recording);
+          return 1;
+        }
+
+      printf ("Recording %s, %u frames\n", recording, file.frameCount ());
+
+      // Benchmark the middle frame, where a face is most likely tracked
+      if (file.frameCount ())
+        {
+          RecordedFrameView view;
+          file.frame (file.frameCount () / 2, view);
+
+          BenchFrame frame;
+          unsigned pixels = view.header->pixels;
+          frame.dd = view.header->dd;
+          frame.amplitudes.assign (view.amplitudes, view.amplitudes + pixels);
+          frame.coordinates.assign (view.coordinates, view.coordinates + pixels * 3);
+          frame.flags.assign (view.flags, view.flags + pixels);
+
+          runBenchmarks (frame, cascade, iterations);
+        }
+    }
+
+  return 0;
+}
@@ -0,0 +1,16 @@
+TEMPLATE = app
+CONFIG += console release
+CONFIG -= app_bundle
+QMAKE_LIBDIR += /usr/local/lib
+LIBS += -lopencv_core -lopencv_objdetect -lopencv_video -lopencv_imgproc
+INCLUDEPATH += ..
+DEPENDPATH += . ..
+
+QT += gui
+
+include(../core/core.pri)
+
+# Input
+HEADERS += ../framefile.hpp ../preview.hpp
+SOURCES += bench.cpp ../framefile.cpp ../preview.cpp
+TARGET   = bench
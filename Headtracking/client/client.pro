@@ -0,0 +1,12 @@
+# Reads the poses published with --publish, to link into other programs.
+# Needs neither Qt, OpenCV nor the PMD SDK.
+TEMPLATE = lib
+CONFIG += staticlib debug_and_release
+CONFIG -= qt
+INCLUDEPATH += . ../core
+DEPENDPATH += . ../core
+LIBS += -lrt
+
+HEADERS += poseclient.hpp ../core/posering.hpp ../core/headpose.hpp ../core/atomics.hpp
+SOURCES += poseclient.cpp
+TARGET   = headtrackingclient
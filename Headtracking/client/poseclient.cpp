@@ -0,0 +1,137 @@
+#include "poseclient.hpp"
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// Attempts at a record the publisher is writing at the same time. Writing
+// takes well under a microsecond, so a few are plenty.
+static const int s_retries = 8;
+
+PoseClient::PoseClient ()
+{
+  m_ring = NULL;
+  m_cursor = 0;
+  m_missed = 0;
+}
+
+PoseClient::~PoseClient ()
+{
+  close ();
+}
+
+bool PoseClient::open (const char *name)
+{
+  close ();
+
+  int fd = shm_open (name, O_RDONLY, 0);
+  if (fd < 0)
+    {
+      return false;
+    }
+
+  void *p = mmap (NULL, sizeof (PoseRing), PROT_READ, MAP_SHARED, fd, 0);
+  ::close (fd);
+
+  if (p == MAP_FAILED)
+    {
+      return false;
+    }
+
+  const PoseRing *ring = (const PoseRing *) p;
+
+  // The publisher sets the magic after everything else
+  if (loadAcquire (&ring->header.magic) != (uint32_t) POSE_RING_MAGIC || ring->header.version != POSE_RING_VERSION ||
+      ring->header.capacity != POSE_RING_CAPACITY || ring->header.recordSize != sizeof (PoseRecord))
+    {
+      fprintf (stderr, "%s is not a pose ring of this version\n", name);
+      munmap (p, sizeof (PoseRing));
+      return false;
+    }
+
+  m_ring = ring;
+
+  // Start with the poses published from now on
+  m_cursor = loadAcquire (&m_ring->header.written);
+  m_missed = 0;
+  return true;
+}
+
+void PoseClient::close ()
+{
+  if (m_ring)
+    {
+      munmap ((void *) m_ring, sizeof (PoseRing));
+      m_ring = NULL;
+    }
+}
+
+bool PoseClient::isOpen () const
+{
+  return m_ring != NULL;
+}
+
+bool PoseClient::latest (PoseRecord & record) const
+{
+  if (!m_ring)
+    {
+      return false;
+    }
+
+  for (int i = 0; i < s_retries; ++i)
+    {
+      uint64_t written = loadAcquire (&m_ring->header.written);
+      if (written == 0)
+        {
+          return false;
+        }
+
+      if (readPoseRecord (m_ring, written - 1, record))
+        {
+          return true;
+        }
+    }
+
+  return false;
+}
+
+bool PoseClient::next (PoseRecord & record)
+{
+  if (!m_ring)
+    {
+      return false;
+    }
+
+  for (int i = 0; i < s_retries; ++i)
+    {
+      uint64_t written = loadAcquire (&m_ring->header.written);
+      if (m_cursor >= written)
+        {
+          // Also after the publisher restarted with an empty ring
+          m_cursor = written;
+          return false;
+        }
+
+      // The slot of the oldest record is the one written next
+      uint64_t oldest = (written > POSE_RING_CAPACITY - 1) ? written - (POSE_RING_CAPACITY - 1) : 0;
+      if (m_cursor < oldest)
+        {
+          m_missed += oldest - m_cursor;
+          m_cursor = oldest;
+        }
+
+      if (readPoseRecord (m_ring, m_cursor, record))
+        {
+          ++m_cursor;
+          return true;
+        }
+    }
+
+  return false;
+}
+
+uint64_t PoseClient::missed () const
+{
+  return m_missed;
+}
@@ -0,0 +1,47 @@
+#ifndef POSECLIENT_HPP_2617480395
+#define POSECLIENT_HPP_2617480395
+
+#include "posering.hpp"
+
+/** Reads the poses a PosePublisher puts into shared memory.
+ * Only opening the ring takes system calls; latest and next are plain
+ * reads of the mapped memory, cheap enough for every rendered frame.
+ * Any number of clients can read at the same time, none of them slows the
+ * tracker down.
+ */
+class PoseClient
+{
+public:
+
+  PoseClient ();
+  ~PoseClient ();
+
+      /** Map the ring the tracker publishes in, e.g. "/headtracking".
+       * Returns false if it does not exist or is of another version. */
+  bool open (const char *name);
+
+  void close ();
+
+  bool isOpen () const;
+
+      /** Copy the newest pose. Returns false if nothing was published yet. */
+  bool latest (PoseRecord & record) const;
+
+      /** Copy the oldest pose not read by next before. Returns false if
+       * there is no new one. A client that falls behind by more than the
+       * ring holds skips to the oldest pose still there, see missed. */
+  bool next (PoseRecord & record);
+
+      /** Number of poses next skipped because they were overwritten */
+  uint64_t missed () const;
+
+private:
+
+  const PoseRing *m_ring;
+
+      /** Running number of the record next reads */
+  uint64_t m_cursor;
+  uint64_t m_missed;
+};
+
+#endif // POSECLIENT_HPP_2617480395
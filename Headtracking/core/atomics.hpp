@@ -0,0 +1,41 @@
+#ifndef ATOMICS_HPP_5093318274
+#define ATOMICS_HPP_5093318274
+
+/** Minimal acquire / release accessors for data shared between threads.
+ * The core does not depend on Qt, so QAtomicInt is not available here.
+ */
+
+template < typename T > inline T loadAcquire (const volatile T * p)
+{
+  return __atomic_load_n (p, __ATOMIC_ACQUIRE);
+}
+
+template < typename T > inline void storeRelease (volatile T * p, T value)
+{
+  __atomic_store_n (p, value, __ATOMIC_RELEASE);
+}
+
+template < typename T > inline T loadRelaxed (const volatile T * p)
+{
+  return __atomic_load_n (p, __ATOMIC_RELAXED);
+}
+
+template < typename T > inline void storeRelaxed (volatile T * p, T value)
+{
+  __atomic_store_n (p, value, __ATOMIC_RELAXED);
+}
+
+/** Replace a value written by several threads if it is still the expected
+ * one, returns whether it was. Acquires on success. */
+template < typename T > inline bool compareAndSwapAcquire (volatile T * p, T expected, T desired)
+{
+  return __atomic_compare_exchange_n (p, &expected, desired, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+/** Add to a value written by several threads, returns the value before */
+template < typename T > inline T fetchAddRelaxed (volatile T * p, T value)
+{
+  return __atomic_fetch_add (p, value, __ATOMIC_RELAXED);
+}
+
+#endif // ATOMICS_HPP_5093318274
@@ -0,0 +1,16 @@
+# Tracking core, shared by the library target and its consumers
+INCLUDEPATH += $$PWD /usr/local/pmd/include /usr/local/include/opencv /usr/local/include/opencv2
+DEPENDPATH += $$PWD
+
+HEADERS += $$PWD/headtracker.hpp $$PWD/headpose.hpp $$PWD/pointsource.hpp \
+           $$PWD/headtrackfilter.hpp $$PWD/depthheaddetector.hpp $$PWD/reorient.hpp $$PWD/timestamp.hpp \
+           $$PWD/latencystats.hpp $$PWD/atomics.hpp $$PWD/kalman.hpp $$PWD/trackmanager.hpp \
+           $$PWD/headposition.hpp $$PWD/headregistration.hpp $$PWD/posering.hpp $$PWD/posepublisher.hpp \
+           $$PWD/posefusion.hpp $$PWD/exposurecontrol.hpp $$PWD/temporalfilter.hpp
+SOURCES += $$PWD/headtracker.cpp $$PWD/headtrackfilter.cpp $$PWD/depthheaddetector.cpp $$PWD/reorient.cpp \
+           $$PWD/latencystats.cpp $$PWD/trackmanager.cpp $$PWD/headposition.cpp \
+           $$PWD/headregistration.cpp $$PWD/posepublisher.cpp \
+           $$PWD/posefusion.cpp $$PWD/exposurecontrol.cpp $$PWD/temporalfilter.cpp
+
+# shm_open, and the thread keys of LatencyStats
+LIBS += -lrt -lpthread
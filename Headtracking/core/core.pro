@@ -0,0 +1,9 @@
+TEMPLATE = lib
+CONFIG += staticlib debug_and_release
+CONFIG -= qt
+QMAKE_LIBDIR += /usr/local/lib
+LIBS += -lopencv_core -lopencv_objdetect -lopencv_video -lopencv_imgproc
+
+include(core.pri)
+
+TARGET   = headtrackingcore
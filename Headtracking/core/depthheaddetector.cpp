@@ -0,0 +1,302 @@
+#include "depthheaddetector.hpp"
+
+#include <pmdsdk2.h>
+#include <math.h>
+#include <algorithm>
+
+// Depth histogram with 2 cm bins up to 5 m
+static const float s_binsPerMeter = 50.0f;
+static const int s_binCount = 250;
+
+// The nearest surface is searched in windows of this many bins (10 cm),
+// about the depth of a face
+static const int s_surfaceBins = 5;
+
+// Runs shorter than this are noise
+static const int s_minRun = 3;
+
+DepthHeadDetector::DepthHeadDetector ()
+{
+  m_minHeadWidth = 0.10f;
+  m_maxHeadWidth = 0.28f;
+  m_foregroundDepth = 0.5f;
+  m_near = 0.0f;
+
+  m_histogram.resize (s_binCount);
+}
+
+void DepthHeadDetector::setHeadWidth (float minWidth, float maxWidth)
+{
+  m_minHeadWidth = minWidth;
+  m_maxHeadWidth = maxWidth;
+}
+
+void DepthHeadDetector::setForegroundDepth (float depth)
+{
+  m_foregroundDepth = depth;
+}
+
+float DepthHeadDetector::nearestDepth () const
+{
+  return m_near;
+}
+
+float DepthHeadDetector::minHeadWidth () const
+{
+  return m_minHeadWidth;
+}
+
+float DepthHeadDetector::maxHeadWidth () const
+{
+  return m_maxHeadWidth;
+}
+
+float DepthHeadDetector::foregroundDepth () const
+{
+  return m_foregroundDepth;
+}
+
+bool DepthHeadDetector::isForeground (float z) const
+{
+  return z >= m_near && z <= m_near + m_foregroundDepth;
+}
+
+bool DepthHeadDetector::findRun (int row, int width, int &left, int &right) const
+{
+  const float *depth = &m_depth[row * width];
+  bool overlap = left <= right;
+
+  int bestLeft = 0, bestRight = -1;
+
+  int x = 0;
+  while (x < width)
+    {
+      if (!isForeground (depth[x]))
+        {
+          ++x;
+          continue;
+        }
+
+      int start = x;
+      while (x < width && isForeground (depth[x]))
+        {
+          ++x;
+        }
+      int end = x - 1;
+
+      if (end - start + 1 < s_minRun)
+        {
+          continue;
+        }
+      if (overlap && (end < left || start > right))
+        {
+          continue;
+        }
+      if (end - start > bestRight - bestLeft)
+        {
+          bestLeft = start;
+          bestRight = end;
+        }
+    }
+
+  if (bestRight < bestLeft)
+    {
+      return false;
+    }
+
+  left = bestLeft;
+  right = bestRight;
+  return true;
+}
+
+bool DepthHeadDetector::findNearest (const float *coords, const unsigned *flags, int pixels)
+{
+  m_near = 0.0f;
+
+  if (pixels <= 0)
+    {
+      return false;
+    }
+
+  // Only grows, so steady state does not allocate
+  if ((int) m_depth.size () < pixels)
+    {
+      m_depth.resize (pixels);
+    }
+
+  float *depth = &m_depth[0];
+  const float maxDepth = s_binCount / s_binsPerMeter;
+
+  // Branch free, so the compiler can vectorize it
+  for (int i = 0; i < pixels; ++i)
+    {
+      float z = coords[i * 3 + 2];
+      bool valid = (flags[i] & PMD_FLAG_INCONSISTENT) == 0 && z > 0.0f && z < maxDepth;
+      depth[i] = valid ? z : 0.0f;
+    }
+
+  unsigned *histogram = &m_histogram[0];
+  std::fill (m_histogram.begin (), m_histogram.end (), 0u);
+
+  for (int i = 0; i < pixels; ++i)
+    {
+      ++histogram[(int) (depth[i] * s_binsPerMeter)];
+    }
+
+  // Nearest surface that is more than a few speckles. Bin 0 holds the
+  // invalid pixels.
+  unsigned minPixels = std::max (pixels / 300, 16);
+  unsigned sum = 0;
+
+  for (int b = 1; b < s_binCount; ++b)
+    {
+      sum += histogram[b];
+      if (b > s_surfaceBins)
+        {
+          sum -= histogram[b - s_surfaceBins];
+        }
+      if (sum >= minPixels)
+        {
+          int first = std::max (b - s_surfaceBins + 1, 1);
+          while (!histogram[first])
+            {
+              ++first;
+            }
+          m_near = first / s_binsPerMeter;
+          break;
+        }
+    }
+
+  return m_near > 0.0f;
+}
+
+bool DepthHeadDetector::findForeground (const float *coords, const unsigned *flags, int width, int height,
+                                        Rect & region, float &pitch)
+{
+  if (!findNearest (coords, flags, width * height))
+    {
+      return false;
+    }
+
+  int x0 = width, y0 = height, x1 = -1, y1 = -1;
+  double angle = 0.0;
+  int span = 0;
+
+  for (int y = 0; y < height; ++y)
+    {
+      int l = 1, r = 0;
+      if (!findRun (y, width, l, r))
+        {
+          continue;
+        }
+
+      x0 = std::min (x0, l);
+      x1 = std::max (x1, r);
+      y0 = std::min (y0, y);
+      y1 = y;
+
+      // Angle between the ends of the run, for the size of a pixel
+      const float *cl = coords + (y * width + l) * 3;
+      const float *cr = coords + (y * width + r) * 3;
+      if (r > l)
+        {
+          angle += fabs (atan2 (cr[0], cr[2]) - atan2 (cl[0], cl[2]));
+          span += r - l;
+        }
+    }
+
+  if (x1 < x0 || !span)
+    {
+      return false;
+    }
+
+  region = Rect (x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+  pitch = angle / span;
+  return pitch > 0.0f;
+}
+
+bool DepthHeadDetector::detect (const float *coords, const unsigned *flags, int width, int height, Rect & head)
+{
+  if (!findNearest (coords, flags, width * height))
+    {
+      return false;
+    }
+
+  // Top of the user is the first row with a long enough run
+  int top = -1, left = 0, right = -1;
+
+  for (int y = 0; y < height && top < 0; ++y)
+    {
+      int l = 1, r = 0;
+      if (findRun (y, width, l, r))
+        {
+          top = y;
+          left = l;
+          right = r;
+        }
+    }
+
+  if (top < 0)
+    {
+      return false;
+    }
+
+  const float *topPoint = coords + (top * width + (left + right) / 2) * 3;
+
+  float headWidth = 0.0f;
+  int headLeft = left, headRight = right, headBottom = top;
+  bool shoulders = false;
+
+  // Follow the user downwards until the body gets clearly wider than the
+  // head, or it is too long to be one
+  int y;
+  for (y = top; y < height; ++y)
+    {
+      int l = left, r = right;
+      if (!findRun (y, width, l, r))
+        {
+          break;
+        }
+
+      float w = fabsf (coords[(y * width + r) * 3] - coords[(y * width + l) * 3]);
+      float drop = fabsf (coords[(y * width + (l + r) / 2) * 3 + 1] - topPoint[1]);
+      float size = std::max (headWidth, m_minHeadWidth);
+
+      if (headWidth > 0.0f && w > 1.6f * headWidth && drop > 0.6f * headWidth)
+        {
+          shoulders = true;
+          break;
+        }
+      if (drop > 2.2f * size)
+        {
+          break;
+        }
+
+      if (drop <= 1.3f * size)
+        {
+          headWidth = std::max (headWidth, w);
+          headLeft = std::min (headLeft, l);
+          headRight = std::max (headRight, r);
+          headBottom = y;
+        }
+
+      left = l;
+      right = r;
+    }
+
+  // Without shoulders the user has to continue out of the image, otherwise
+  // it is something like a raised hand
+  if (!shoulders && y < height)
+    {
+      return false;
+    }
+
+  if (headWidth < m_minHeadWidth || headWidth > m_maxHeadWidth)
+    {
+      return false;
+    }
+
+  head = Rect (headLeft, top, headRight - headLeft + 1, headBottom - top + 1);
+
+  return head.width >= 4 && head.height >= 4;
+}
@@ -0,0 +1,83 @@
+#ifndef DEPTHHEADDETECTOR_HPP_2291730584
+#define DEPTHHEADDETECTOR_HPP_2291730584
+
+#include <vector>
+
+#include <opencv/cxcore.h>
+
+using namespace cv;
+
+/** Finds the head in the upright point cloud of a frame.
+ * The nearest surface that covers enough pixels is taken as the user. The
+ * foreground within a depth band behind it is then followed from its top
+ * row downwards, one run of pixels per row, and has to look like a head on
+ * shoulders: a head sized width at the top and a clearly wider body below.
+ * Works on the metric coordinates only, so it does not care where the user
+ * is looking.
+ */
+class DepthHeadDetector
+{
+public:
+
+  DepthHeadDetector ();
+
+      /** Find the head.
+       * \param coords Upright 3D coordinates in meters, width * height * 3
+       * \param flags Upright PMD flags, inconsistent pixels are ignored
+       * \param width Width of the image
+       * \param height Height of the image
+       * \param head Receives the head in image coordinates
+       * \return true if a head was found
+       */
+  bool detect (const float *coords, const unsigned *flags, int width, int height, Rect & head);
+
+      /** Find where the user is, without looking for the head.
+       * \param region Receives the bounding box of the foreground
+       * \param pitch Receives the angle in radians covered by one pixel,
+       * so a width w at depth z covers w / (z * pitch) pixels
+       * \return false if there is no foreground
+       */
+  bool findForeground (const float *coords, const unsigned *flags, int width, int height,
+                       Rect & region, float &pitch);
+
+      /** Range of plausible head widths in meters, 0.10 to 0.28 by default */
+  void setHeadWidth (float minWidth, float maxWidth);
+
+      /** Depth in meters behind the nearest surface that still belongs to
+       * the user, 0.5 by default */
+  void setForegroundDepth (float depth);
+
+      /** Depth of the nearest surface in the last frame, 0 if there was none */
+  float nearestDepth () const;
+
+  float minHeadWidth () const;
+  float maxHeadWidth () const;
+  float foregroundDepth () const;
+
+private:
+
+      /** Fill the depth map and find the nearest surface. Returns false if
+       * there is none. */
+  bool findNearest (const float *coords, const unsigned *flags, int pixels);
+
+      /** Find the run of foreground pixels in a row that overlaps the
+       * columns from left to right, or the widest if left > right. Returns
+       * false if there is none. */
+  bool findRun (int row, int width, int &left, int &right) const;
+
+  bool isForeground (float z) const;
+
+      /** Depth of every pixel, 0 where it is invalid */
+  std::vector < float >m_depth;
+
+      /** Number of pixels per depth bin */
+  std::vector < unsigned >m_histogram;
+
+  float m_minHeadWidth;
+  float m_maxHeadWidth;
+  float m_foregroundDepth;
+
+  float m_near;
+};
+
+#endif // DEPTHHEADDETECTOR_HPP_2291730584
@@ -0,0 +1,197 @@
+#include "exposurecontrol.hpp"
+#include "atomics.hpp"
+
+#include <pmdsdk2.h>
+#include <float.h>
+#include <string.h>
+#include <algorithm>
+
+// Enough samples for a stable percentile, cheap enough for every frame
+static const int s_maxSamples = 256;
+
+// Measurements with the new integration time that are skipped after a
+// change, as the camera may still deliver frames exposed before it
+static const unsigned s_settleFrames = 2;
+
+// Smaller changes are not worth making, unless the frame rate asks for them
+static const float s_minChange = 0.1f;
+
+// Largest change of one step, in case the measurement is far off
+static const float s_maxStep = 2.0f;
+
+float roiAmplitude (const float *amps, const unsigned *flags, int width, int height,
+                    int left, int top, int roiWidth, int roiHeight)
+{
+  int x0 = std::max (left, 0);
+  int y0 = std::max (top, 0);
+  int x1 = std::min (left + roiWidth, width);
+  int y1 = std::min (top + roiHeight, height);
+
+  if (x1 <= x0 || y1 <= y0)
+    {
+      return 0.0f;
+    }
+
+  int step = 1;
+  while (((x1 - x0 + step - 1) / step) * ((y1 - y0 + step - 1) / step) > s_maxSamples)
+    {
+      ++step;
+    }
+
+  float samples[s_maxSamples];
+  int n = 0;
+
+  for (int y = y0; y < y1; y += step)
+    {
+      for (int x = x0; x < x1; x += step)
+        {
+          int idx = y * width + x;
+          samples[n++] = (flags && (flags[idx] & PMD_FLAG_SATURATED)) ? FLT_MAX : amps[idx];
+        }
+    }
+
+  float *p90 = samples + (n - 1) * 9 / 10;
+  std::nth_element (samples, p90, samples + n);
+  return *p90;
+}
+
+ExposureControl::ExposureControl ()
+{
+  m_minUs = 50;
+  m_maxUs = 2000;
+  m_fps = 60.0f;
+  m_low = 700.0f;
+  m_high = 1400.0f;
+
+  m_integrationUs = 500;
+  m_previousUs = 500;
+  m_rejectedUs = 0;
+  m_settle = 0;
+
+  m_measurement = 0;
+  m_measured = 0;
+  m_seen = 0;
+}
+
+void ExposureControl::setLimits (unsigned minUs, unsigned maxUs)
+{
+  m_minUs = std::max (minUs, 1u);
+  m_maxUs = std::max (maxUs, m_minUs);
+}
+
+void ExposureControl::setFrameRateTarget (float fps)
+{
+  m_fps = std::max (fps, 0.0f);
+}
+
+void ExposureControl::setTargetBand (float low, float high)
+{
+  m_low = low;
+  m_high = std::max (high, low);
+}
+
+void ExposureControl::setIntegrationTime (unsigned us)
+{
+  m_integrationUs = us;
+  m_rejectedUs = 0;
+}
+
+unsigned ExposureControl::integrationTime () const
+{
+  return m_integrationUs;
+}
+
+unsigned ExposureControl::maxIntegrationTime () const
+{
+  if (m_fps <= 0.0f)
+    {
+      return m_maxUs;
+    }
+
+  // A frame is four exposures of the integration time, one per phase, and
+  // their readout; a fifth of the frame period leaves room for the latter
+  unsigned us = (unsigned) (1e6f / (5.0f * m_fps));
+  return std::max (m_minUs, std::min (m_maxUs, us));
+}
+
+void ExposureControl::measure (float amplitude, unsigned integrationUs)
+{
+  uint32_t bits;
+  memcpy (&bits, &amplitude, sizeof (bits));
+
+  storeRelaxed (&m_measurement, ((uint64_t) bits << 32) | integrationUs);
+  storeRelease (&m_measured, loadRelaxed (&m_measured) + 1);
+}
+
+bool ExposureControl::update (unsigned &integrationUs)
+{
+  uint32_t measured = loadAcquire (&m_measured);
+  if (measured == m_seen)
+    {
+      return false;
+    }
+  m_seen = measured;
+
+  // A newer measurement may have replaced the one counted, which is just
+  // as good
+  uint64_t packed = loadRelaxed (&m_measurement);
+  uint32_t bits = (uint32_t) (packed >> 32);
+  unsigned takenUs = (unsigned) (packed & 0xffffffffu);
+
+  float amplitude;
+  memcpy (&amplitude, &bits, sizeof (amplitude));
+
+  // Only frames taken with the current time tell what it does
+  if (takenUs != m_integrationUs)
+    {
+      return false;
+    }
+  if (m_settle)
+    {
+      --m_settle;
+      return false;
+    }
+
+  unsigned limit = maxIntegrationTime ();
+
+  float factor = 1.0f;
+  if (amplitude > m_high || amplitude < m_low)
+    {
+      factor = (amplitude > 0.0f) ? 0.5f * (m_low + m_high) / amplitude : s_maxStep;
+      factor = std::max (1.0f / s_maxStep, std::min (factor, s_maxStep));
+    }
+
+  unsigned next = (unsigned) (m_integrationUs * factor + 0.5f);
+  next = std::max (m_minUs, std::min (next, limit));
+
+  unsigned change = (next > m_integrationUs) ? next - m_integrationUs : m_integrationUs - next;
+  if (change == 0 || (change < s_minChange * m_integrationUs && m_integrationUs <= limit))
+    {
+      return false;
+    }
+
+  // The camera rounds the rejected time back to the current one, and any
+  // smaller step the same way as well
+  if (m_rejectedUs && ((m_integrationUs < next && next <= m_rejectedUs)
+                       || (m_rejectedUs <= next && next < m_integrationUs)))
+    {
+      return false;
+    }
+
+  m_previousUs = m_integrationUs;
+  m_rejectedUs = 0;
+  m_integrationUs = next;
+  m_settle = s_settleFrames;
+
+  integrationUs = next;
+  return true;
+}
+
+void ExposureControl::rejectUpdate ()
+{
+  // Frames keep coming with the unchanged time, so there is nothing to
+  // settle
+  m_rejectedUs = m_integrationUs;
+  m_integrationUs = m_previousUs;
+  m_settle = 0;
+}
@@ -0,0 +1,103 @@
+#ifndef EXPOSURECONTROL_HPP_6093718254
+#define EXPOSURECONTROL_HPP_6093718254
+
+#include <stdint.h>
+
+/** Bright end of the amplitudes of a rectangle: the amplitude nine in ten
+ * sampled pixels stay below. Saturated pixels count as brighter than any
+ * other, so a rectangle with more than a tenth of them saturated returns
+ * FLT_MAX.
+ * \param amps Upright amplitudes
+ * \param flags Upright flags, NULL if they are not valid in the rectangle
+ * \param width Width of the image
+ * \param height Height of the image
+ * \param left, top, roiWidth, roiHeight Rectangle, clipped to the image
+ * \return The amplitude, 0 if the rectangle is empty
+ */
+float roiAmplitude (const float *amps, const unsigned *flags, int width, int height,
+                    int left, int top, int roiWidth, int roiHeight);
+
+/** Closed loop control of the integration time of a camera.
+ * The tracking thread measures the amplitude of the head with
+ * roiAmplitude on every frame and hands it over with measure. The thread
+ * that owns the camera handle calls update after each frame and sets the
+ * integration time it returns. As the amplitude grows in proportion to the
+ * integration time, one step moves the amplitude of the head to the
+ * middle of the target band; within the band nothing changes, so the
+ * camera does not hunt. Frames taken before the last change took effect
+ * are not used to decide the next one.
+ *
+ * The integration time is also kept short enough for the target frame
+ * rate. A close head, which is bright, thus gets a short exposure with
+ * less motion blur, and the camera reaches a higher frame rate.
+ */
+class ExposureControl
+{
+public:
+
+  ExposureControl ();
+
+      /** Shortest and longest integration time the camera takes, in
+       * microseconds, 50 and 2000 by default */
+  void setLimits (unsigned minUs, unsigned maxUs);
+
+      /** Frame rate the integration time must leave room for, 60 by
+       * default, 0 for none */
+  void setFrameRateTarget (float fps);
+
+      /** Band of head amplitudes, in the units of pmdCalcAmplitudes, that
+       * needs no change. 700 to 1400 by default. */
+  void setTargetBand (float low, float high);
+
+      /** Integration time the camera is set to, e.g. the one it was opened
+       * with. Camera thread only. */
+  void setIntegrationTime (unsigned us);
+  unsigned integrationTime () const;
+
+      /** Tracking thread: amplitude of the head, or of the whole image
+       * while there is none, in a frame taken with the given integration
+       * time */
+  void measure (float amplitude, unsigned integrationUs);
+
+      /** Camera thread: decide on the newest measurement. Returns true and
+       * the new integration time if the camera should be set to it. */
+  bool update (unsigned &integrationUs);
+
+      /** Camera thread: the camera cannot take the time the last update
+       * returned and stays at the one before. The control stays settled
+       * and does not ask again for a change in that direction that is no
+       * larger. */
+  void rejectUpdate ();
+
+private:
+
+      /** Longest integration time for the frame rate target */
+  unsigned maxIntegrationTime () const;
+
+  unsigned m_minUs;
+  unsigned m_maxUs;
+  float m_fps;
+  float m_low;
+  float m_high;
+
+  unsigned m_integrationUs;
+
+      /** Integration time before the last update, and the one the camera
+       * rejected last, 0 for none */
+  unsigned m_previousUs;
+  unsigned m_rejectedUs;
+
+      /** Calls of update left before measurements are used again */
+  unsigned m_settle;
+
+      /** Newest measurement, the amplitude in the upper and the
+       * integration time in the lower half, and the number of
+       * measurements so far, published after it */
+  volatile uint64_t m_measurement;
+  volatile uint32_t m_measured;
+
+      /** Number of measurements the last update had seen */
+  uint32_t m_seen;
+};
+
+#endif // EXPOSURECONTROL_HPP_6093718254
@@ -0,0 +1,90 @@
+#ifndef HEADPOSE_HPP_6602187345
+#define HEADPOSE_HPP_6602187345
+
+#include <stdint.h>
+#include <math.h>
+
+/** Head pose of one frame */
+struct HeadPose
+{
+      /** Capture time of the frame in microseconds of the monotonic clock */
+  uint64_t timestampUs;
+
+  unsigned frameId;
+
+      /** 0 if no face was found, 1 if it was detected, 2 if it was tracked */
+  int state;
+
+      /** Face rectangle in the tracking image */
+  int faceLeft;
+  int faceTop;
+  int faceWidth;
+  int faceHeight;
+
+      /** Last measured head position in meters */
+  float position[3];
+
+      /** Kalman filtered head position in meters, for the capture time.
+       * Comes from the same corrected state as the velocity. */
+  float filtered[3];
+
+      /** Kalman filtered velocity in meters per second, to extrapolate the
+       * filtered position to later times */
+  float velocity[3];
+
+      /** Yaw, pitch and roll of the head in radians, relative to the head
+       * when it was first seen, see HeadRegistration. 0 while unknown. */
+  float orientation[3];
+
+      /** 0 if no face was found, 0.5 if it was detected and the template
+       * match score, above 0.85, if it was tracked */
+  float confidence;
+};
+
+/** Velocity in meters per second from the per frame velocity of a Kalman
+ * filter that steps once per frame. Frames replayed as fast as they are
+ * tracked come closer together than any camera takes them, so the interval
+ * is taken as at least that of a fast camera, and the speed is limited to
+ * what a head does.
+ * \param perFrame Velocity of the filter state in meters per frame
+ * \param frameIntervalUs Smoothed time between two frames, 0 if unknown
+ * \param velocity Receives the velocity, 0 without an interval
+ */
+inline void velocityPerSecond (const float *perFrame, float frameIntervalUs, float *velocity)
+{
+  const float minIntervalUs = 2000.0f;
+  const float maxSpeed = 5.0f;
+
+  float perSecond = (frameIntervalUs > 0.0f) ? 1e6f / (frameIntervalUs > minIntervalUs ? frameIntervalUs :
+                                                        minIntervalUs) : 0.0f;
+
+  float speed = 0.0f;
+  for (int i = 0; i < 3; ++i)
+    {
+      velocity[i] = perFrame[i] * perSecond;
+      speed += velocity[i] * velocity[i];
+    }
+
+  speed = sqrtf (speed);
+  if (speed > maxSpeed)
+    {
+      for (int i = 0; i < 3; ++i)
+        {
+          velocity[i] *= maxSpeed / speed;
+        }
+    }
+}
+
+/** Pose of one of several heads tracked at once, see TrackManager */
+struct TrackedHead
+{
+      /** Stays the same as long as the head is tracked */
+  unsigned id;
+
+      /** Number of frames since the head was found */
+  unsigned age;
+
+  HeadPose pose;
+};
+
+#endif // HEADPOSE_HPP_6602187345
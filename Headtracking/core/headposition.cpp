@@ -0,0 +1,148 @@
+#include "headposition.hpp"
+
+#include <pmdsdk2.h>
+#include <algorithm>
+#include <string.h>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+// Enough samples for a stable median, few enough to stay as cheap as the
+// 11 x 11 window that was averaged before
+static const int s_maxSamples = 96;
+
+// The median is taken from a depth histogram with 2 cm bins up to 5 m,
+// which is cheaper than sorting the samples
+static const float s_binsPerMeter = 50.0f;
+static const int s_binCount = 256;
+
+// Half the depth band around the median that counts as face
+static const float s_depthGate = 0.06f;
+
+bool estimateHeadPosition (const float *amps, const float *coords, const unsigned *flags, int width, int height,
+                           int left, int top, int faceWidth, int faceHeight, float *position)
+{
+  int x0 = std::max (left, 0);
+  int y0 = std::max (top, 0);
+  int x1 = std::min (left + faceWidth, width);
+  int y1 = std::min (top + faceHeight, height);
+
+  if (x1 <= x0 || y1 <= y0)
+    {
+      return false;
+    }
+
+  // Spread the samples over the whole rectangle
+  int step = 1;
+  while (((x1 - x0 + step - 1) / step) * ((y1 - y0 + step - 1) / step) > s_maxSamples)
+    {
+      ++step;
+    }
+
+  // Valid samples, split into one array per coordinate so the second
+  // pass reads them four at a time. The arrays are padded to a multiple of
+  // four with samples that lie outside any depth band and weigh nothing.
+  float xs[s_maxSamples + 3] __attribute__ ((aligned (16)));
+  float ys[s_maxSamples + 3] __attribute__ ((aligned (16)));
+  float zs[s_maxSamples + 3] __attribute__ ((aligned (16)));
+  float ws[s_maxSamples + 3] __attribute__ ((aligned (16)));
+  int n = 0;
+
+  for (int y = y0; y < y1; y += step)
+    {
+      for (int x = x0; x < x1; x += step)
+        {
+          int idx = y * width + x;
+          const float *p = coords + idx * 3;
+          if ((flags[idx] & PMD_FLAG_INCONSISTENT) == 0x0 && p[2] > 0.0f)
+            {
+              xs[n] = p[0];
+              ys[n] = p[1];
+              zs[n] = p[2];
+              ws[n] = amps[idx];
+              ++n;
+            }
+        }
+    }
+
+  if (!n)
+    {
+      return false;
+    }
+
+  int padded = (n + 3) & ~3;
+  for (int i = n; i < padded; ++i)
+    {
+      xs[i] = ys[i] = zs[i] = ws[i] = 0.0f;
+    }
+
+  unsigned short histogram[s_binCount];
+  memset (histogram, 0, sizeof (histogram));
+  for (int i = 0; i < n; ++i)
+    {
+      ++histogram[std::min ((int) (zs[i] * s_binsPerMeter), s_binCount - 1)];
+    }
+
+  int bin = 0;
+  for (int count = histogram[0]; count <= n / 2; count += histogram[++bin])
+    {
+    }
+
+  const float median = (bin + 0.5f) / s_binsPerMeter;
+  const float nearest = median - s_depthGate;
+  const float farthest = median + s_depthGate;
+
+  float sumX, sumY, sumZ, sumW;
+
+#ifdef __SSE__
+  __m128 accX = _mm_setzero_ps (), accY = _mm_setzero_ps (), accZ = _mm_setzero_ps (), accW = _mm_setzero_ps ();
+  const __m128 lo = _mm_set1_ps (nearest);
+  const __m128 hi = _mm_set1_ps (farthest);
+
+  for (int i = 0; i < padded; i += 4)
+    {
+      __m128 z = _mm_load_ps (zs + i);
+      __m128 inside = _mm_and_ps (_mm_cmpge_ps (z, lo), _mm_cmple_ps (z, hi));
+      __m128 w = _mm_and_ps (inside, _mm_load_ps (ws + i));
+
+      accX = _mm_add_ps (accX, _mm_mul_ps (w, _mm_load_ps (xs + i)));
+      accY = _mm_add_ps (accY, _mm_mul_ps (w, _mm_load_ps (ys + i)));
+      accZ = _mm_add_ps (accZ, _mm_mul_ps (w, z));
+      accW = _mm_add_ps (accW, w);
+    }
+
+  float lanes[4] __attribute__ ((aligned (16)));
+  _mm_store_ps (lanes, accX);
+  sumX = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  _mm_store_ps (lanes, accY);
+  sumY = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  _mm_store_ps (lanes, accZ);
+  sumZ = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  _mm_store_ps (lanes, accW);
+  sumW = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#else
+  sumX = sumY = sumZ = sumW = 0.0f;
+
+  // Branch free
+  for (int i = 0; i < padded; ++i)
+    {
+      float w = (zs[i] >= nearest && zs[i] <= farthest) ? ws[i] : 0.0f;
+      sumX += w * xs[i];
+      sumY += w * ys[i];
+      sumZ += w * zs[i];
+      sumW += w;
+    }
+#endif
+
+  if (sumW <= 0.0f)
+    {
+      return false;
+    }
+
+  float inv = 1.0f / sumW;
+  position[0] = sumX * inv;
+  position[1] = sumY * inv;
+  position[2] = sumZ * inv;
+  return true;
+}
@@ -0,0 +1,22 @@
+#ifndef HEADPOSITION_HPP_4417096382
+#define HEADPOSITION_HPP_4417096382
+
+/** Measure the head position from the points of its face rectangle.
+ * Samples the whole rectangle, at most 96 pixels spread evenly over it,
+ * and drops pixels the PMD SDK flags as inconsistent. The median depth of
+ * the rest is taken as the face; pixels more than 6 cm in front of or
+ * behind it, like hair, the background beside the head or flying pixels at
+ * its edges, are left out of the amplitude weighted mean.
+ * \param amps Upright amplitudes
+ * \param coords Upright 3D coordinates in meters
+ * \param flags Upright flags
+ * \param width Width of the image
+ * \param height Height of the image
+ * \param left, top, faceWidth, faceHeight Face rectangle, clipped to the image
+ * \param position Receives the position in meters
+ * \return false if the rectangle has no valid points
+ */
+bool estimateHeadPosition (const float *amps, const float *coords, const unsigned *flags, int width, int height,
+                           int left, int top, int faceWidth, int faceHeight, float *position);
+
+#endif // HEADPOSITION_HPP_4417096382
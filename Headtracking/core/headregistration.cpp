@@ -0,0 +1,455 @@
+#include "headregistration.hpp"
+
+#include <pmdsdk2.h>
+#include <algorithm>
+#include <string.h>
+#include <math.h>
+
+// Size of a height map cell, so the map covers 38 cm around the head and
+// a pixel of a head at 1 m still hits every cell
+static const float s_cellSize = 0.006f;
+
+// Points further than this from the measured head position along the
+// camera axis are background
+static const float s_depthGate = 0.12f;
+
+// Points further than this from the model are outliers
+static const float s_maxResidual = 0.02f;
+
+// Gauss-Newton steps per frame; starting at the last pose, the steps after
+// the first few hardly move
+static const int s_maxSteps = 5;
+
+// A frame needs this many points on the model, and an RMS distance below
+// s_maxRms, to count as a fit
+static const int s_minPoints = 30;
+static const float s_maxRms = 0.01f;
+
+// Frames in a row that may fail to fit before the model is started anew
+static const unsigned s_maxFailures = 10;
+
+// Number of samples a cell averages before it is fixed, so the small
+// errors of later registrations do not make the model drift
+static const float s_maxWeight = 20.0f;
+
+/** Rotation matrix of a rotation vector */
+static void rotationFromVector (const float *w, float r[3][3])
+{
+  float angle = sqrtf (w[0] * w[0] + w[1] * w[1] + w[2] * w[2]);
+  if (angle < 1e-9f)
+    {
+      r[0][0] = 1.0f;
+      r[0][1] = -w[2];
+      r[0][2] = w[1];
+      r[1][0] = w[2];
+      r[1][1] = 1.0f;
+      r[1][2] = -w[0];
+      r[2][0] = -w[1];
+      r[2][1] = w[0];
+      r[2][2] = 1.0f;
+      return;
+    }
+
+  float x = w[0] / angle, y = w[1] / angle, z = w[2] / angle;
+  float c = cosf (angle), s = sinf (angle), t = 1.0f - c;
+
+  r[0][0] = t * x * x + c;
+  r[0][1] = t * x * y - s * z;
+  r[0][2] = t * x * z + s * y;
+  r[1][0] = t * x * y + s * z;
+  r[1][1] = t * y * y + c;
+  r[1][2] = t * y * z - s * x;
+  r[2][0] = t * x * z - s * y;
+  r[2][1] = t * y * z + s * x;
+  r[2][2] = t * z * z + c;
+}
+
+/** Solve a x = b for a symmetric positive definite 6 x 6 matrix with a
+ * Cholesky decomposition. Returns false if a is not positive definite. */
+static bool solve6 (float a[6][6], const float *b, float *x)
+{
+  float l[6][6];
+
+  for (int i = 0; i < 6; ++i)
+    {
+      for (int j = 0; j <= i; ++j)
+        {
+          float s = a[i][j];
+          for (int k = 0; k < j; ++k)
+            {
+              s -= l[i][k] * l[j][k];
+            }
+          if (i == j)
+            {
+              if (s <= 0.0f)
+                {
+                  return false;
+                }
+              l[i][i] = sqrtf (s);
+            }
+          else
+            {
+              l[i][j] = s / l[j][j];
+            }
+        }
+    }
+
+  float y[6];
+  for (int i = 0; i < 6; ++i)
+    {
+      float s = b[i];
+      for (int k = 0; k < i; ++k)
+        {
+          s -= l[i][k] * y[k];
+        }
+      y[i] = s / l[i][i];
+    }
+
+  for (int i = 5; i >= 0; --i)
+    {
+      float s = y[i];
+      for (int k = i + 1; k < 6; ++k)
+        {
+          s -= l[k][i] * x[k];
+        }
+      x[i] = s / l[i][i];
+    }
+
+  return true;
+}
+
+HeadRegistration::HeadRegistration ()
+{
+  reset ();
+}
+
+void HeadRegistration::reset ()
+{
+  memset (m_heights, 0, sizeof (m_heights));
+  memset (m_weights, 0, sizeof (m_weights));
+  memset (m_rotation, 0, sizeof (m_rotation));
+  memset (m_translation, 0, sizeof (m_translation));
+  memset (m_lastCenter, 0, sizeof (m_lastCenter));
+
+  m_rotation[0][0] = m_rotation[1][1] = m_rotation[2][2] = 1.0f;
+
+  m_hasModel = false;
+  m_failures = 0;
+  m_residual = 0.0f;
+}
+
+bool HeadRegistration::hasOrientation () const
+{
+  return m_hasModel;
+}
+
+float HeadRegistration::residual () const
+{
+  return m_residual;
+}
+
+void HeadRegistration::orientation (float *yawPitchRoll) const
+{
+  // rotation = Ry (yaw) Rx (pitch) Rz (roll)
+  yawPitchRoll[0] = atan2f (m_rotation[0][2], m_rotation[2][2]);
+  yawPitchRoll[1] = asinf (std::max (-1.0f, std::min (1.0f, -m_rotation[1][2])));
+  yawPitchRoll[2] = atan2f (m_rotation[1][0], m_rotation[1][1]);
+}
+
+void HeadRegistration::toHead (float x, float y, float z, float *p) const
+{
+  x -= m_translation[0];
+  y -= m_translation[1];
+  z -= m_translation[2];
+
+  // Transposed rotation
+  p[0] = m_rotation[0][0] * x + m_rotation[1][0] * y + m_rotation[2][0] * z;
+  p[1] = m_rotation[0][1] * x + m_rotation[1][1] * y + m_rotation[2][1] * z;
+  p[2] = m_rotation[0][2] * x + m_rotation[1][2] * y + m_rotation[2][2] * z;
+}
+
+int HeadRegistration::samplePoints (const float *coords, const unsigned *flags, int width, int height,
+                                    int left, int top, int faceWidth, int faceHeight, const float *center)
+{
+  int x0 = std::max (left, 0);
+  int y0 = std::max (top, 0);
+  int x1 = std::min (left + faceWidth, width);
+  int y1 = std::min (top + faceHeight, height);
+
+  if (x1 <= x0 || y1 <= y0)
+    {
+      return 0;
+    }
+
+  int step = 1;
+  while (((x1 - x0 + step - 1) / step) * ((y1 - y0 + step - 1) / step) > MAX_POINTS)
+    {
+      ++step;
+    }
+
+  int n = 0;
+  for (int y = y0; y < y1; y += step)
+    {
+      for (int x = x0; x < x1; x += step)
+        {
+          int idx = y * width + x;
+          const float *p = coords + idx * 3;
+          if ((flags[idx] & PMD_FLAG_INCONSISTENT) == 0x0 && p[2] > 0.0f && fabsf (p[2] - center[2]) < s_depthGate)
+            {
+              m_xs[n] = p[0];
+              m_ys[n] = p[1];
+              m_zs[n] = p[2];
+              ++n;
+            }
+        }
+    }
+
+  return n;
+}
+
+bool HeadRegistration::lookup (float x, float y, float &h, float &dx, float &dy) const
+{
+  float u = x / s_cellSize + GRID_SIZE / 2 - 0.5f;
+  float v = y / s_cellSize + GRID_SIZE / 2 - 0.5f;
+
+  if (u < 0.0f || v < 0.0f || u >= GRID_SIZE - 1 || v >= GRID_SIZE - 1)
+    {
+      return false;
+    }
+
+  int j = (int) u, i = (int) v;
+  float fu = u - j, fv = v - i;
+
+  if (m_weights[i][j] <= 0.0f || m_weights[i][j + 1] <= 0.0f ||
+      m_weights[i + 1][j] <= 0.0f || m_weights[i + 1][j + 1] <= 0.0f)
+    {
+      return false;
+    }
+
+  float h00 = m_heights[i][j], h01 = m_heights[i][j + 1];
+  float h10 = m_heights[i + 1][j], h11 = m_heights[i + 1][j + 1];
+
+  float top = h00 + (h01 - h00) * fu;
+  float bottom = h10 + (h11 - h10) * fu;
+
+  h = top + (bottom - top) * fv;
+  dx = ((h01 - h00) * (1.0f - fv) + (h11 - h10) * fv) / s_cellSize;
+  dy = (bottom - top) / s_cellSize;
+  return true;
+}
+
+bool HeadRegistration::registerPoints (int n)
+{
+  int inliers = 0;
+  float sumSquares = 0.0f;
+
+  for (int step = 0; step < s_maxSteps; ++step)
+    {
+      // Normal equations of the residuals r = z - h (x, y) in head
+      // coordinates. A small motion w, v of a point p in head coordinates
+      // changes r by (p x g) . w + g . v with g = (-dh/dx, -dh/dy, 1).
+      float a[6][6];
+      float b[6];
+      memset (a, 0, sizeof (a));
+      memset (b, 0, sizeof (b));
+
+      inliers = 0;
+      sumSquares = 0.0f;
+
+      for (int k = 0; k < n; ++k)
+        {
+          float p[3];
+          toHead (m_xs[k], m_ys[k], m_zs[k], p);
+
+          float h, hx, hy;
+          if (!lookup (p[0], p[1], h, hx, hy))
+            {
+              continue;
+            }
+
+          float r = p[2] - h;
+          if (fabsf (r) > s_maxResidual)
+            {
+              continue;
+            }
+
+          float g[3] = { -hx, -hy, 1.0f };
+          float j[6] = {
+            p[1] * g[2] - p[2] * g[1],
+            p[2] * g[0] - p[0] * g[2],
+            p[0] * g[1] - p[1] * g[0],
+            g[0], g[1], g[2]
+          };
+
+          for (int row = 0; row < 6; ++row)
+            {
+              for (int col = 0; col <= row; ++col)
+                {
+                  a[row][col] += j[row] * j[col];
+                }
+              b[row] -= j[row] * r;
+            }
+
+          ++inliers;
+          sumSquares += r * r;
+        }
+
+      if (inliers < s_minPoints)
+        {
+          return false;
+        }
+
+      // Damped, as a face constrains some motions only weakly
+      float damping = 1e-3f * (a[0][0] + a[1][1] + a[2][2] + a[3][3] + a[4][4] + a[5][5]) / 6.0f;
+      for (int row = 0; row < 6; ++row)
+        {
+          a[row][row] += damping;
+          for (int col = 0; col < row; ++col)
+            {
+              a[col][row] = a[row][col];
+            }
+        }
+
+      float delta[6];
+      if (!solve6 (a, b, delta))
+        {
+          return false;
+        }
+
+      // The points move by delta in head coordinates: p' = dR p + v.
+      // Folded into the pose: R' = R dR^T, t' = t - R' v.
+      float dr[3][3];
+      rotationFromVector (delta, dr);
+
+      float r[3][3];
+      for (int row = 0; row < 3; ++row)
+        {
+          for (int col = 0; col < 3; ++col)
+            {
+              r[row][col] = m_rotation[row][0] * dr[col][0] + m_rotation[row][1] * dr[col][1] +
+                m_rotation[row][2] * dr[col][2];
+            }
+        }
+      memcpy (m_rotation, r, sizeof (m_rotation));
+
+      for (int row = 0; row < 3; ++row)
+        {
+          m_translation[row] -= m_rotation[row][0] * delta[3] + m_rotation[row][1] * delta[4] +
+            m_rotation[row][2] * delta[5];
+        }
+
+      float moved = fabsf (delta[0]) + fabsf (delta[1]) + fabsf (delta[2]) +
+        (fabsf (delta[3]) + fabsf (delta[4]) + fabsf (delta[5])) * 10.0f;
+      if (moved < 1e-4f)
+        {
+          break;
+        }
+    }
+
+  float rms = sqrtf (sumSquares / inliers);
+  if (rms > s_maxRms)
+    {
+      return false;
+    }
+
+  m_residual = rms;
+  return true;
+}
+
+void HeadRegistration::addToModel (const float *coords, const unsigned *flags, int width, int height,
+                                   int left, int top, int faceWidth, int faceHeight, const float *center)
+{
+  int x0 = std::max (left, 0);
+  int y0 = std::max (top, 0);
+  int x1 = std::min (left + faceWidth, width);
+  int y1 = std::min (top + faceHeight, height);
+
+  for (int y = y0; y < y1; ++y)
+    {
+      for (int x = x0; x < x1; ++x)
+        {
+          int idx = y * width + x;
+          const float *q = coords + idx * 3;
+          if ((flags[idx] & PMD_FLAG_INCONSISTENT) != 0x0 || q[2] <= 0.0f || fabsf (q[2] - center[2]) >= s_depthGate)
+            {
+              continue;
+            }
+
+          float p[3];
+          toHead (q[0], q[1], q[2], p);
+
+          int j = (int) floorf (p[0] / s_cellSize + GRID_SIZE / 2);
+          int i = (int) floorf (p[1] / s_cellSize + GRID_SIZE / 2);
+          if (i < 0 || j < 0 || i >= GRID_SIZE || j >= GRID_SIZE)
+            {
+              continue;
+            }
+
+          float &h = m_heights[i][j];
+          float &w = m_weights[i][j];
+
+          // Points far from a known surface are outliers; cells without
+          // one take any point, so the model grows when the head turns
+          if (w >= s_maxWeight || (w > 0.0f && fabsf (p[2] - h) > s_maxResidual))
+            {
+              continue;
+            }
+
+          h = (h * w + p[2]) / (w + 1.0f);
+          w = std::min (w + 1.0f, s_maxWeight);
+        }
+    }
+}
+
+bool HeadRegistration::update (const float *coords, const unsigned *flags, int width, int height,
+                               int left, int top, int faceWidth, int faceHeight, const float *center)
+{
+  int n = samplePoints (coords, flags, width, height, left, top, faceWidth, faceHeight, center);
+  if (n < s_minPoints)
+    {
+      return false;
+    }
+
+  if (!m_hasModel)
+    {
+      // The head as it is now is the reference orientation
+      m_translation[0] = center[0];
+      m_translation[1] = center[1];
+      m_translation[2] = center[2];
+      memcpy (m_lastCenter, center, sizeof (m_lastCenter));
+
+      addToModel (coords, flags, width, height, left, top, faceWidth, faceHeight, center);
+      m_hasModel = true;
+      m_failures = 0;
+      return true;
+    }
+
+  // Start where the head moved to
+  for (int i = 0; i < 3; ++i)
+    {
+      m_translation[i] += center[i] - m_lastCenter[i];
+    }
+  memcpy (m_lastCenter, center, sizeof (m_lastCenter));
+
+  float rotation[3][3];
+  float translation[3];
+  memcpy (rotation, m_rotation, sizeof (rotation));
+  memcpy (translation, m_translation, sizeof (translation));
+
+  if (!registerPoints (n))
+    {
+      // Keep the last pose, and start over if the model no longer fits
+      memcpy (m_rotation, rotation, sizeof (m_rotation));
+      memcpy (m_translation, translation, sizeof (m_translation));
+
+      if (++m_failures > s_maxFailures)
+        {
+          reset ();
+        }
+      return false;
+    }
+
+  m_failures = 0;
+  addToModel (coords, flags, width, height, left, top, faceWidth, faceHeight, center);
+  return true;
+}
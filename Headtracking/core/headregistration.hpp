@@ -0,0 +1,104 @@
+#ifndef HEADREGISTRATION_HPP_8163025947
+#define HEADREGISTRATION_HPP_8163025947
+
+/** Orientation of the head from the points of the face.
+ * The face is modelled as a height map in head coordinates, built from the
+ * first frames and extended with every frame that fits it. Each frame a few
+ * points are sampled from the face rectangle, and Gauss-Newton steps
+ * starting at the pose of the last frame register them against the model.
+ * Every step is linear in the number of points, so a few steps on a few
+ * hundred points cost far less than a frame.
+ *
+ * The orientation is relative to the head when the model was started, so
+ * looking straight at the camera then gives yaw, pitch and roll of 0.
+ */
+class HeadRegistration
+{
+public:
+
+  HeadRegistration ();
+
+      /** Forget the model; the next frame starts a new one */
+  void reset ();
+
+      /** Register the face of a frame.
+       * \param coords Upright 3D coordinates in meters
+       * \param flags Upright flags
+       * \param width Width of the image
+       * \param height Height of the image
+       * \param left, top, faceWidth, faceHeight Face rectangle
+       * \param center Measured position of the head in meters
+       * \return true if the face fit the model, or started it
+       */
+  bool update (const float *coords, const unsigned *flags, int width, int height,
+               int left, int top, int faceWidth, int faceHeight, const float *center);
+
+      /** Whether there is an orientation, i.e. a model was started */
+  bool hasOrientation () const;
+
+      /** Yaw, pitch and roll of the head in radians, applied in this order.
+       * Yaw turns around the vertical axis, pitch nods and roll tilts. */
+  void orientation (float *yawPitchRoll) const;
+
+      /** RMS distance of the points to the model in the last frame that
+       * fit, in meters */
+  float residual () const;
+
+private:
+
+  enum
+  {
+        /** Cells of the height map per side */
+    GRID_SIZE = 64,
+
+        /** Most points sampled per frame */
+    MAX_POINTS = 384
+  };
+
+      /** Sample the points of the face rectangle near the head into the
+       * point arrays, returns their number */
+  int samplePoints (const float *coords, const unsigned *flags, int width, int height,
+                    int left, int top, int faceWidth, int faceHeight, const float *center);
+
+      /** Height of the model and its slope at a point in head coordinates.
+       * Returns false where the model has no surface. */
+  bool lookup (float x, float y, float &h, float &dx, float &dy) const;
+
+      /** Gauss-Newton registration of the sampled points, returns false if
+       * they do not fit */
+  bool registerPoints (int n);
+
+      /** Add all points of the face rectangle that lie near the surface to
+       * the model. Uses every pixel rather than the samples, so the model
+       * has no holes between them. */
+  void addToModel (const float *coords, const unsigned *flags, int width, int height,
+                   int left, int top, int faceWidth, int faceHeight, const float *center);
+
+      /** Head coordinates of a camera point */
+  void toHead (float x, float y, float z, float *p) const;
+
+      /** Model heights along the camera axis and number of samples
+       * averaged in each cell, 0 where there is no surface */
+  float m_heights[GRID_SIZE][GRID_SIZE];
+  float m_weights[GRID_SIZE][GRID_SIZE];
+
+  bool m_hasModel;
+
+      /** Pose of the head, camera = rotation * head + translation */
+  float m_rotation[3][3];
+  float m_translation[3];
+
+      /** Measured head position of the last frame, to move the pose with it
+       * before registering */
+  float m_lastCenter[3];
+
+  unsigned m_failures;
+  float m_residual;
+
+      /** Sampled points in camera coordinates, one array per coordinate */
+  float m_xs[MAX_POINTS];
+  float m_ys[MAX_POINTS];
+  float m_zs[MAX_POINTS];
+};
+
+#endif // HEADREGISTRATION_HPP_8163025947
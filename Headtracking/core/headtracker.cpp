@@ -0,0 +1,410 @@
+#include "headtracker.hpp"
+#include "reorient.hpp"
+#include "latencystats.hpp"
+#include "atomics.hpp"
+#include "headposition.hpp"
+
+#include <string.h>
+
+HeadTracker::HeadTracker (const char *cascadeFile)
+{
+  m_reservedPixels = 0;
+  m_rows = 0;
+  m_columns = 0;
+  m_pixelOrigin = 0;
+  m_amplitudes = NULL;
+  m_coords = NULL;
+  m_flags = NULL;
+
+  m_fullPointCloud = true;
+  m_temporalFilterEnabled = false;
+  m_pointSource = NULL;
+  m_srcCoords = NULL;
+  m_srcFlags = NULL;
+
+  m_headPosition[0] = 0.0f;
+  m_headPosition[1] = 0.0f;
+  m_headPosition[2] = 2.0f;
+
+  m_orientationEnabled = true;
+
+  m_filter = new HeadTrackFilter (cascadeFile);
+
+  m_cascadeFile = cascadeFile;
+  m_trackManager = NULL;
+  m_maxHeads = 1;
+
+  m_firstCoords = true;
+  m_resetRequested = 0;
+
+  m_motionModel = MOTION_CONSTANT_VELOCITY;
+  m_lastTimestampUs = 0;
+  m_frameIntervalUs = 0.0f;
+
+  setConstantVelocity < 3 > (m_velocityFilter, 1.0f);
+  setConstantAcceleration < 3 > (m_accelerationFilter, 1.0f);
+}
+
+HeadTracker::~HeadTracker ()
+{
+  delete m_filter;
+  delete m_trackManager;
+
+  delete[]m_amplitudes;
+  delete[]m_coords;
+  delete[]m_flags;
+}
+
+void HeadTracker::setFormat (unsigned rows, unsigned columns, unsigned pixelOrigin)
+{
+  m_pixelOrigin = pixelOrigin;
+  m_rows = rows;
+  m_columns = columns;
+
+  // If format has changed reinitialize arrays
+  if (m_rows * m_columns != m_reservedPixels)
+    {
+      m_reservedPixels = m_rows * m_columns;
+
+      delete[]m_amplitudes;
+      m_amplitudes = new float[m_reservedPixels];
+
+      delete[]m_flags;
+      m_flags = new unsigned[m_reservedPixels];
+
+      memset (m_flags, 0, m_reservedPixels * sizeof (unsigned));
+
+      delete[]m_coords;
+      m_coords = new float[m_reservedPixels * 3];
+    }
+
+  // Only reallocates if the size changed
+  m_gray.create (height (), width (), CV_8UC1);
+}
+
+void HeadTracker::setFullPointCloud (bool enabled)
+{
+  m_fullPointCloud = enabled;
+}
+
+void HeadTracker::setTemporalFilter (bool enabled)
+{
+  m_temporalFilterEnabled = enabled;
+  m_temporalFilter.reset ();
+  m_firstCoords = true;
+}
+
+TemporalFilter & HeadTracker::temporalFilter ()
+{
+  return m_temporalFilter;
+}
+
+void HeadTracker::resetTemporalFilter ()
+{
+  m_temporalFilter.reset ();
+}
+
+void HeadTracker::setPointSource (PointSource * source)
+{
+  m_pointSource = source;
+}
+
+void HeadTracker::process (const float *amps, const float *coords, const unsigned *flags,
+                           uint64_t timestampUs, unsigned frameId, HeadPose & pose)
+{
+  if (loadAcquire (&m_resetRequested))
+    {
+      storeRelaxed (&m_resetRequested, 0);
+      reset ();
+    }
+
+  float max = 0.0f;
+  bool full = m_fullPointCloud && coords;
+
+  m_srcCoords = coords;
+  m_srcFlags = flags;
+
+  {
+    StageTimer timer (STAGE_REORIENT);
+    reorientBuffers (m_pixelOrigin, m_rows, m_columns, amps, full ? coords : NULL, flags,
+                     m_amplitudes, m_coords, m_flags, max);
+  }
+
+  if (m_temporalFilterEnabled && full)
+    {
+      StageTimer timer (STAGE_TEMPORAL);
+      m_temporalFilter.filter (m_amplitudes, m_coords, m_flags, width () * height ());
+    }
+
+  bool multiple = m_maxHeads > 1;
+
+  // A tracked face will most likely be found again, so let the points be
+  // calculated while the face is searched
+  if (!coords && m_pointSource && (m_filter->isTracking () || (multiple && !heads ().empty ())))
+    {
+      m_pointSource->requestPoints ();
+    }
+
+  {
+    StageTimer timer (STAGE_GRAY);
+    amplitudesToGray (m_amplitudes, m_gray.cols, m_gray.rows, max, m_gray.data, m_gray.step);
+  }
+
+  if (multiple)
+    {
+      processHeads (full, timestampUs, frameId, pose);
+      return;
+    }
+
+  // The depth based detectors need the points of the whole image, but
+  // only when they run; if the template is lost within findFace they fall
+  // back to the cascade unless all points are there anyway
+  if (m_filter->detectionMode () != HeadTrackFilter::DETECT_HAAR)
+    {
+      bool points = full || (m_filter->needsDetection () && loadRegion (0, 0, width (), height ()));
+      m_filter->setPoints (points ? m_coords : NULL, m_flags);
+    }
+
+  int faceX, faceY;
+  int nLeft = 0, nTop = 0, nWidth = 0, nHeight = 0;
+
+  // Find the face
+  int nRes = m_filter->findFace (m_gray, nLeft, nTop, nWidth, nHeight, faceX, faceY);
+  if (nRes > 0 && (full || loadRegion (nLeft, nTop, nWidth, nHeight)))
+    {
+      {
+        StageTimer timer (STAGE_GET_COORDS);
+        getCoords (nLeft, nTop, nWidth, nHeight);
+      }
+
+      if (m_orientationEnabled)
+        {
+          StageTimer timer (STAGE_ORIENTATION);
+          m_registration.update (m_coords, m_flags, width (), height (), nLeft, nTop, nWidth, nHeight,
+                                 m_headPosition);
+        }
+    }
+
+  // Lets the template follow the face when it moves in depth
+  if (nRes > 0)
+    {
+      m_filter->setHeadDepth (m_headPosition[2]);
+    }
+
+  pose.timestampUs = timestampUs;
+  pose.frameId = frameId;
+  pose.state = nRes;
+  pose.faceLeft = nLeft;
+  pose.faceTop = nTop;
+  pose.faceWidth = nWidth;
+  pose.faceHeight = nHeight;
+  pose.position[0] = m_headPosition[0];
+  pose.position[1] = m_headPosition[1];
+  pose.position[2] = m_headPosition[2];
+  pose.confidence = (nRes == 2) ? m_filter->matchScore () : 0.5f * nRes;
+
+  if (m_orientationEnabled && m_registration.hasOrientation ())
+    {
+      m_registration.orientation (pose.orientation);
+    }
+  else
+    {
+      memset (pose.orientation, 0, sizeof (pose.orientation));
+    }
+
+  filterPosition (pose.filtered);
+
+  // The filter steps once per frame, so its velocity is per frame
+  if (m_lastTimestampUs && timestampUs > m_lastTimestampUs)
+    {
+      float interval = timestampUs - m_lastTimestampUs;
+      m_frameIntervalUs = (m_frameIntervalUs > 0.0f) ? 0.9f * m_frameIntervalUs + 0.1f * interval : interval;
+    }
+  m_lastTimestampUs = timestampUs;
+
+  const float *state = (m_motionModel == MOTION_CONSTANT_ACCELERATION) ?
+    m_accelerationFilter.statePost : m_velocityFilter.statePost;
+  velocityPerSecond (state + 3, m_frameIntervalUs, pose.velocity);
+}
+
+void HeadTracker::processHeads (bool full, uint64_t timestampUs, unsigned frameId, HeadPose & pose)
+{
+  // Without the full point cloud only the points around the tracked faces
+  // are needed, and those of the whole image when new heads are looked for
+  bool points = full;
+  if (!full)
+    {
+      m_trackManager->track (m_gray);
+
+      Rect region = m_trackManager->needsDetection () ? Rect (0, 0, width (), height ()) :
+        m_trackManager->trackedRegion ();
+      points = region.area () > 0 && loadRegion (region.x, region.y, region.width, region.height);
+    }
+
+  m_trackManager->update (m_gray, m_amplitudes, points ? m_coords : NULL, m_flags, timestampUs, frameId);
+
+  const std::vector < TrackedHead > &all = m_trackManager->heads ();
+  if (!all.empty ())
+    {
+      pose = all[0].pose;
+      memcpy (m_headPosition, pose.position, sizeof (m_headPosition));
+      return;
+    }
+
+  // Nobody there, stay where the last head was
+  memset (&pose, 0, sizeof (pose));
+  pose.timestampUs = timestampUs;
+  pose.frameId = frameId;
+  memcpy (pose.position, m_headPosition, sizeof (pose.position));
+  memcpy (pose.filtered, m_headPosition, sizeof (pose.filtered));
+}
+
+void HeadTracker::getCoords (int left, int top, int width, int height)
+{
+  // Keeps the last position if the face has no valid points
+  estimateHeadPosition (m_amplitudes, m_coords, m_flags, m_gray.cols, m_gray.rows, left, top, width, height,
+                        m_headPosition);
+}
+
+void HeadTracker::filterPosition (float *filtered)
+{
+  StageTimer timer (STAGE_KALMAN);
+
+  if (m_firstCoords)
+    {
+      resetKalman ();
+      m_firstCoords = false;
+    }
+
+  // The position is taken after the correction, like the velocity, so
+  // both come from the same state
+  const float *state;
+
+  if (m_motionModel == MOTION_CONSTANT_ACCELERATION)
+    {
+      m_accelerationFilter.predict ();
+      m_accelerationFilter.correct (m_headPosition);
+      state = m_accelerationFilter.statePost;
+    }
+  else
+    {
+      m_velocityFilter.predict ();
+      m_velocityFilter.correct (m_headPosition);
+      state = m_velocityFilter.statePost;
+    }
+
+  filtered[0] = state[0];
+  filtered[1] = state[1];
+  filtered[2] = state[2];
+}
+
+bool HeadTracker::loadRegion (int left, int top, int width, int height)
+{
+  if (!m_srcCoords)
+    {
+      if (!m_pointSource || !m_pointSource->points (m_srcCoords, m_srcFlags))
+        {
+          return false;
+        }
+    }
+
+  reorientRegion (m_pixelOrigin, m_rows, m_columns, m_srcCoords, m_srcFlags, left, top, width, height,
+                  m_coords, m_flags);
+  return true;
+}
+
+void HeadTracker::resetKalman ()
+{
+  // Initialize Kalman filter. The noise was tuned in millimeters; scaling
+  // all covariances by 1e-6 gives the same filter in meters. The measurement
+  // noise was 2e+2 when the position came from a small window around one
+  // pixel; the depth gated estimate over the whole face is several times
+  // steadier, so the filter can follow it more closely. Averaged over time
+  // by the temporal filter it is steadier still.
+  float measurementNoise = m_temporalFilterEnabled ? 2e+1f : 5e+1f;
+  m_velocityFilter.setCovariances (1e-3f * 1e-6f, measurementNoise * 1e-6f, 1e-6f);
+  m_accelerationFilter.setCovariances (1e-3f * 1e-6f, measurementNoise * 1e-6f, 1e-6f);
+}
+
+void HeadTracker::setMotionModel (MotionModel model)
+{
+  m_motionModel = model;
+  m_firstCoords = true;
+}
+
+void HeadTracker::setMaxHeads (unsigned count)
+{
+  m_maxHeads = count;
+
+  if (m_maxHeads > 1)
+    {
+      if (!m_trackManager)
+        {
+          m_trackManager = new TrackManager (m_cascadeFile.c_str ());
+        }
+      m_trackManager->setMaxHeads (m_maxHeads);
+    }
+}
+
+const std::vector < TrackedHead > &HeadTracker::heads () const
+{
+  return (m_maxHeads > 1) ? m_trackManager->heads () : m_noHeads;
+}
+
+void HeadTracker::setOrientationEnabled (bool enabled)
+{
+  m_orientationEnabled = enabled;
+}
+
+void HeadTracker::setDetectionMode (HeadTrackFilter::DetectionMode mode)
+{
+  m_filter->setDetectionMode (mode);
+}
+
+void HeadTracker::reset ()
+{
+  resetKalman ();
+  m_filter->resetHead ();
+  m_registration.reset ();
+  m_temporalFilter.reset ();
+
+  if (m_trackManager)
+    {
+      m_trackManager->reset ();
+    }
+}
+
+void HeadTracker::requestReset ()
+{
+  storeRelease (&m_resetRequested, 1);
+}
+
+const Mat & HeadTracker::grayImage () const
+{
+  return m_gray;
+}
+
+const float *HeadTracker::amplitudes () const
+{
+  return m_amplitudes;
+}
+
+const float *HeadTracker::coordinates () const
+{
+  return m_coords;
+}
+
+const unsigned *HeadTracker::flags () const
+{
+  return m_flags;
+}
+
+unsigned HeadTracker::width () const
+{
+  return ((m_pixelOrigin & 0xffff0000) == PMD_DIRECTION_VERTICAL) ? m_rows : m_columns;
+}
+
+unsigned HeadTracker::height () const
+{
+  return ((m_pixelOrigin & 0xffff0000) == PMD_DIRECTION_VERTICAL) ? m_columns : m_rows;
+}
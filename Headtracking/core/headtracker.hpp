@@ -0,0 +1,221 @@
+#ifndef HEADTRACKER_HPP_1846203957
+#define HEADTRACKER_HPP_1846203957
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <opencv/cxcore.h>
+#include <opencv/cv.h>
+
+#include <pmdsdk2.h>
+
+#include "headtrackfilter.hpp"
+#include "headpose.hpp"
+#include "pointsource.hpp"
+#include "kalman.hpp"
+#include "trackmanager.hpp"
+#include "headregistration.hpp"
+#include "temporalfilter.hpp"
+
+/** Head tracking pipeline without any user interface.
+ * Takes the amplitude, coordinate and flag buffers of a frame as calculated
+ * by the PMD SDK, brings them upright, finds the face and returns the
+ * smoothed 3D head position.
+ */
+class HeadTracker
+{
+public:
+
+      /** How the head is expected to move between two frames */
+  enum MotionModel
+  {
+    MOTION_CONSTANT_VELOCITY,
+    MOTION_CONSTANT_ACCELERATION
+  };
+
+      /** Constructor
+       * \param cascadeFile Haar cascade used to detect faces
+       */
+  HeadTracker (const char *cascadeFile = "haarcascade_frontalface_alt.xml");
+
+      /** Destructor */
+  ~HeadTracker ();
+
+      /** Set the layout of the following frames. Buffers are only
+       * reallocated if the number of pixels changes.
+       */
+  void setFormat (unsigned rows, unsigned columns, unsigned pixelOrigin);
+
+      /** Keep the complete upright point cloud of every frame, for
+       * consumers of coordinates () and flags (). Without it only the
+       * face region is reoriented. Enabled by default.
+       */
+  void setFullPointCloud (bool enabled);
+
+      /** Average the amplitudes and points of every pixel over the last
+       * frames with a TemporalFilter before the face is searched. Only the
+       * full point cloud is filtered, so this does nothing without it. The
+       * steadier points let the Kalman filter follow the head more
+       * closely, which makes up for part of the lag of the average. Off by
+       * default. Restarts the Kalman filter.
+       */
+  void setTemporalFilter (bool enabled);
+
+      /** Settings of the temporal filter */
+  TemporalFilter & temporalFilter ();
+
+      /** Forget the averages of the temporal filter, e.g. when the
+       * integration time changed and with it all amplitudes */
+  void resetTemporalFilter ();
+
+      /** Where to get coordinates and flags from when process is called
+       * without them. Not owned.
+       */
+  void setPointSource (PointSource * source);
+
+      /** Process one frame.
+       * \param amps Amplitudes in sensor order
+       * \param coords 3D coordinates in sensor order, NULL to get them from
+       * the point source once a face was found
+       * \param flags Flags in sensor order, NULL together with coords
+       * \param timestampUs Capture time of the frame
+       * \param frameId Frame number, copied into the pose
+       * \param pose Receives the result
+       */
+  void process (const float *amps, const float *coords, const unsigned *flags,
+                uint64_t timestampUs, unsigned frameId, HeadPose & pose);
+
+      /** Select how a new face is found, see HeadTrackFilter */
+  void setDetectionMode (HeadTrackFilter::DetectionMode mode);
+
+      /** Select the model of the Kalman filter, constant velocity by
+       * default. Restarts the filter. */
+  void setMotionModel (MotionModel model);
+
+      /** Track up to count heads at once with a TrackManager, 1 by
+       * default. With more than one, the pose of process is the one of
+       * the longest tracked head and heads () returns all of them. The
+       * motion and detection mode settings only apply to a single head.
+       */
+  void setMaxHeads (unsigned count);
+
+      /** All heads of the last frame, empty when only one head is
+       * tracked */
+  const std::vector < TrackedHead > &heads () const;
+
+      /** Estimate the orientation of the head besides its position,
+       * enabled by default. Needs the points of the face. */
+  void setOrientationEnabled (bool enabled);
+
+      /** Forget the face and restart the Kalman filter */
+  void reset ();
+
+      /** Reset before the next frame is processed. Unlike reset this may
+       * be called from any thread.
+       */
+  void requestReset ();
+
+      /** Tracking image of the last frame */
+  const Mat & grayImage () const;
+
+      /** Upright buffers of the last frame, width () * height () pixels.
+       * Without the full point cloud, coordinates and flags are only valid
+       * around the face. */
+  const float *amplitudes () const;
+  const float *coordinates () const;
+  const unsigned *flags () const;
+
+  unsigned width () const;
+  unsigned height () const;
+
+private:
+
+      /** Measure the position of the head from the points of the face
+       * rectangle, see estimateHeadPosition. Called by process.
+       */
+  void getCoords (int left, int top, int width, int height);
+
+      /** Feed the measured position to the Kalman filter and get the
+       * corrected position. Called by process.
+       */
+  void filterPosition (float *filtered);
+
+  void resetKalman ();
+
+      /** Rest of process when several heads are tracked */
+  void processHeads (bool full, uint64_t timestampUs, unsigned frameId, HeadPose & pose);
+
+      /** Reorient the coordinates and flags of a rectangle of the tracking
+       * image, fetching them from the point source if needed. Returns false
+       * if there are none. */
+  bool loadRegion (int left, int top, int width, int height);
+
+private:
+
+      /** Number of rows in the current image */
+  unsigned m_rows;
+
+      /** Number of columns in the current image */
+  unsigned m_columns;
+
+      /** Origin of the image */
+  unsigned m_pixelOrigin;
+
+      /** Number of pixels currently allocated */
+  unsigned m_reservedPixels;
+
+      /** Amplitudes array */
+  float *m_amplitudes;
+
+      /** Coordinates array */
+  float *m_coords;
+
+      /** Flags array */
+  unsigned *m_flags;
+
+  Mat m_gray;
+
+  bool m_fullPointCloud;
+
+  bool m_temporalFilterEnabled;
+  TemporalFilter m_temporalFilter;
+
+  PointSource *m_pointSource;
+
+      /** Sensor order coordinates and flags of the current frame, NULL
+       * until fetched from the point source */
+  const float *m_srcCoords;
+  const unsigned *m_srcFlags;
+
+  float m_headPosition[3];
+
+  bool m_orientationEnabled;
+  HeadRegistration m_registration;
+
+  HeadTrackFilter *m_filter;
+
+  std::string m_cascadeFile;
+
+      /** Tracks several heads, NULL until more than one is wanted */
+  TrackManager *m_trackManager;
+  unsigned m_maxHeads;
+  std::vector < TrackedHead > m_noHeads;
+
+  bool m_firstCoords;
+
+  volatile int m_resetRequested;
+
+  MotionModel m_motionModel;
+
+      /** Capture time of the last frame and the smoothed time between two
+       * frames, to convert the velocity from per frame to per second */
+  uint64_t m_lastTimestampUs;
+  float m_frameIntervalUs;
+
+      /** Filters in meters and frames, one per motion model */
+  KalmanFilter < 6, 3 > m_velocityFilter;
+  KalmanFilter < 9, 3 > m_accelerationFilter;
+};
+
+#endif // HEADTRACKER_HPP_1846203957
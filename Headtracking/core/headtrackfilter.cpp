@@ -0,0 +1,337 @@
+#include "headtrackfilter.hpp"
+#include "latencystats.hpp"
+
+#include <algorithm>
+#include <math.h>
+
+// Half size in pixels of the first, smallest search window
+static const int s_searchRadius = 8;
+
+HeadTrackFilter::HeadTrackFilter (const char *cascadeFile)
+{
+  m_tracking = false;
+  m_matchScore = 0.0f;
+
+  m_detectionMode = DETECT_DEPTH;
+  m_coords = NULL;
+  m_flags = NULL;
+
+  m_searchWindow = true;
+  m_maxSearchRadius = 0;
+
+  m_scaleAdaptive = true;
+  m_referenceDepth = 0.0f;
+  m_headDepth = 0.0f;
+
+  // Load the classifier
+  // In this case we use the classifier shipped with OpenCV
+  m_hasCascade = cascadeFile != NULL;
+  if (m_hasCascade && !m_cascade.load (cascadeFile))
+    {
+      printf ("Can't load cascade!\n");
+      exit (-1);
+    }
+
+  m_faces.reserve (16);
+}
+
+HeadTrackFilter::~HeadTrackFilter ()
+{
+}
+
+int HeadTrackFilter::findFace (const Mat & image, int &nLeft, int &nTop,
+                               int &nWidth, int &nHeight, int &faceX, int &faceY)
+{
+  faceX = 0;
+  faceY = 0;
+
+  // If no face was found before try to find one with the detector.
+  // If we found a face before and have created a template, try to find the 
+  // template with template matching.
+
+  if (!m_tracking)
+    {
+      StageTimer timer (STAGE_DETECT);
+
+      Rect r;
+      if (detect (image, r))
+        {
+          faceX = r.x + (r.width / 2);
+          faceY = r.y + (r.height / 2);
+
+          nLeft = r.x;
+          nTop = r.y;
+          nWidth = r.width;
+          nHeight = r.height;
+
+          // Create new template
+          startTracking (image, r);
+          return 1;
+        }
+    }
+  else
+    {
+      uint64_t start = monotonicNanoseconds ();
+
+      Rect r;
+      bool found = trackFace (image, r);
+
+      LatencyStats::global ().record (STAGE_MATCH, monotonicNanoseconds () - start);
+
+      if (found)
+        {
+          nLeft = r.x;
+          nTop = r.y;
+          nWidth = r.width;
+          nHeight = r.height;
+
+          // Center, like a detected face, so the depth is measured on the
+          // face and not at its corner
+          faceX = nLeft + (nWidth / 2);
+          faceY = nTop + (nHeight / 2);
+          return 2;
+        }
+      else
+        {
+          return findFace (image, nLeft, nTop, nWidth, nHeight, faceX, faceY);
+        }
+    }
+
+  return 0;
+}
+
+bool HeadTrackFilter::trackFace (const Mat & image, Rect & face)
+{
+  if (!m_tracking)
+    {
+      return false;
+    }
+
+  if (m_scaleAdaptive)
+    {
+      scaleTemplate (image);
+    }
+
+  double max_val = 0;
+  Point max_loc;
+  if (!matchAround (image, max_val, max_loc))
+    {
+      m_tracking = false;
+      m_matchScore = 0.0f;
+      return false;
+    }
+
+  m_matchScore = (float) max_val;
+
+  m_velocity = max_loc - m_lastPosition;
+  m_lastPosition = max_loc;
+  m_predicted = max_loc + m_velocity;
+
+  face = Rect (max_loc.x, max_loc.y, m_depthTemplate.cols, m_depthTemplate.rows);
+
+  // Same size as before, copies into the existing template buffer
+  image (face).copyTo (m_depthTemplate);
+  return true;
+}
+
+bool HeadTrackFilter::detect (const Mat & image, Rect & face)
+{
+  if (m_detectionMode == DETECT_DEPTH && m_coords)
+    {
+      return m_depthDetector.detect (m_coords, m_flags, image.cols, image.rows, face);
+    }
+
+  // Only the Haar detectors need a cascade
+  if (!m_hasCascade)
+    {
+      return false;
+    }
+
+  Rect full (0, 0, image.cols, image.rows);
+  Rect region = full;
+  Size minSize (0, 0), maxSize;
+
+  if (m_detectionMode == DETECT_HAAR_GUIDED && m_coords)
+    {
+      float pitch;
+      if (!m_depthDetector.findForeground (m_coords, m_flags, image.cols, image.rows, region, pitch))
+        {
+          // Nobody in front of the camera
+          return false;
+        }
+
+      // The head is somewhere in the foreground, between the nearest
+      // surface and the far end of the foreground
+      float nearest = m_depthDetector.nearestDepth ();
+      float farthest = nearest + m_depthDetector.foregroundDepth ();
+
+      int maxWidth = (int) ceil (m_depthDetector.maxHeadWidth () / (pitch * nearest)) + 1;
+      int minWidth = std::min ((int) (m_depthDetector.minHeadWidth () / (pitch * farthest)), maxWidth);
+
+      minSize = Size (minWidth, minWidth);
+      maxSize = Size (maxWidth, maxWidth);
+
+      // A face at the edge of the foreground may reach out of it by half
+      region = Rect (region.x - maxWidth / 2, region.y - maxWidth / 2,
+                     region.width + maxWidth, region.height + maxWidth) & full;
+    }
+
+  m_faces.clear ();
+  m_cascade.detectMultiScale (image (region), m_faces, 1.2, 2, CV_HAAR_FIND_BIGGEST_OBJECT | CV_HAAR_SCALE_IMAGE,
+                              minSize, maxSize);
+
+  if (m_faces.empty ())
+    {
+      return false;
+    }
+
+  face = m_faces[0] + region.tl ();
+  return true;
+}
+
+bool HeadTrackFilter::matchAround (const Mat & image, double &maxVal, Point & maxLoc)
+{
+  Rect full (0, 0, image.cols, image.rows);
+
+  // A radius of 0 searches the whole image right away
+  int radius = m_searchWindow ? std::max (s_searchRadius, m_depthTemplate.cols / 4) : 0;
+
+  for (;;)
+    {
+      Rect window = full;
+      if (radius > 0)
+        {
+          window = Rect (m_predicted.x - radius, m_predicted.y - radius,
+                         m_depthTemplate.cols + 2 * radius, m_depthTemplate.rows + 2 * radius) & full;
+        }
+
+      if (window.width >= m_depthTemplate.cols && window.height >= m_depthTemplate.rows)
+        {
+          // The result keeps its buffer as long as the window size stays
+          matchTemplate (image (window), m_depthTemplate, m_matchResult, CV_TM_CCOEFF_NORMED);
+
+          double minVal = 0;
+          Point minLoc;
+          minMaxLoc (m_matchResult, &minVal, &maxVal, &minLoc, &maxLoc);
+
+          maxLoc += window.tl ();
+
+          if (maxVal > 0.85)
+            {
+              return true;
+            }
+        }
+
+      if (window == full || (m_maxSearchRadius > 0 && radius >= m_maxSearchRadius))
+        {
+          return false;
+        }
+
+      radius *= 2;
+    }
+}
+
+void HeadTrackFilter::scaleTemplate (const Mat & image)
+{
+  if (m_referenceDepth <= 0.0f || m_headDepth <= 0.0f)
+    {
+      return;
+    }
+
+  // The face appears inversely proportional to its distance
+  float scale = m_referenceDepth / m_headDepth;
+
+  Size size ((int) (m_referenceSize.width * scale + 0.5f), (int) (m_referenceSize.height * scale + 0.5f));
+  size.width = std::max (8, std::min (size.width, image.cols));
+  size.height = std::max (8, std::min (size.height, image.rows));
+
+  if (size == m_depthTemplate.size ())
+    {
+      return;
+    }
+
+  // Keep the center where it was
+  Point shift ((size.width - m_depthTemplate.cols) / 2, (size.height - m_depthTemplate.rows) / 2);
+  m_lastPosition -= shift;
+  m_predicted -= shift;
+
+  resize (m_depthTemplate, m_scaledTemplate, size, 0, 0, INTER_LINEAR);
+  m_scaledTemplate.copyTo (m_depthTemplate);
+}
+
+void HeadTrackFilter::startTracking (const Mat & image, const Rect & face)
+{
+  image (face).copyTo (m_depthTemplate);
+  m_tracking = true;
+  m_matchScore = 0.0f;
+
+  m_referenceSize = face.size ();
+  m_referenceDepth = 0.0f;
+
+  m_lastPosition = face.tl ();
+  m_velocity = Point (0, 0);
+  m_predicted = m_lastPosition;
+}
+
+void HeadTrackFilter::setSearchWindow (bool enabled)
+{
+  m_searchWindow = enabled;
+}
+
+bool HeadTrackFilter::isTracking () const
+{
+  return m_tracking;
+}
+
+float HeadTrackFilter::matchScore () const
+{
+  return m_matchScore;
+}
+
+void HeadTrackFilter::setMaxSearchRadius (int radius)
+{
+  m_maxSearchRadius = std::max (0, radius);
+}
+
+void HeadTrackFilter::setDetectionMode (DetectionMode mode)
+{
+  m_detectionMode = mode;
+}
+
+HeadTrackFilter::DetectionMode HeadTrackFilter::detectionMode () const
+{
+  return m_detectionMode;
+}
+
+void HeadTrackFilter::setPoints (const float *coords, const unsigned *flags)
+{
+  m_coords = coords;
+  m_flags = flags;
+}
+
+bool HeadTrackFilter::needsDetection () const
+{
+  return !m_tracking;
+}
+
+void HeadTrackFilter::setHeadDepth (float depth)
+{
+  m_headDepth = depth;
+
+  if (m_tracking && m_referenceDepth <= 0.0f)
+    {
+      m_referenceDepth = depth;
+    }
+}
+
+void HeadTrackFilter::setScaleAdaptive (bool enabled)
+{
+  m_scaleAdaptive = enabled;
+}
+
+void HeadTrackFilter::resetHead ()
+{
+  m_tracking = false;
+  m_matchScore = 0.0f;
+  m_referenceDepth = 0.0f;
+}
@@ -0,0 +1,137 @@
+#ifndef HEADTRACKFILTER_HPP_8932408979102
+#define HEADTRACKFILTER_HPP_8932408979102
+
+#include <vector>
+
+#include <opencv/cxcore.h>
+#include <opencv/cv.h>
+
+#include "depthheaddetector.hpp"
+
+using namespace cv;
+
+class HeadTrackFilter
+{
+
+public:
+
+  // / how a face is found when none is tracked
+  enum DetectionMode
+  {
+    // / Haar cascade on the amplitude image
+    DETECT_HAAR,
+    // / head and shoulders in the point cloud, see DepthHeadDetector
+    DETECT_DEPTH,
+    // / Haar cascade limited to the foreground and to the face sizes
+    // / possible at its depth
+    DETECT_HAAR_GUIDED
+  };
+
+  // / the constructor; without a cascade file findFace only detects faces
+  // / with DETECT_DEPTH, the Haar modes then find none
+  HeadTrackFilter (const char *cascadeFile = "haarcascade_frontalface_alt.xml");
+
+  // / the destructor
+  ~HeadTrackFilter ();
+
+  // / find the face in an 8 bit image, returns 0 if none was found, 1 if it
+  // / was detected by the cascade and 2 if it was tracked by the template
+  int findFace (const Mat & image, int &nLeft, int &nTop, int &nWidth, int &nHeight, int &faceX, int &faceY);
+
+  void resetHead ();
+
+  // / select the detector, DETECT_DEPTH by default
+  void setDetectionMode (DetectionMode mode);
+  DetectionMode detectionMode () const;
+
+  // / upright coordinates and flags belonging to the image of the next
+  // / findFace, NULL if there are none; needed for DETECT_DEPTH and
+  // / DETECT_HAAR_GUIDED, which fall back to the plain cascade without them
+  void setPoints (const float *coords, const unsigned *flags);
+
+  // / whether the next findFace will look for a new face, and so may use
+  // / the points
+  bool needsDetection () const;
+
+  // / start template tracking of the given region, as if it had been detected
+  void startTracking (const Mat & image, const Rect & face);
+
+  // / follow the tracked face into the next image by template matching
+  // / only, returns false and stops tracking if it was lost
+  bool trackFace (const Mat & image, Rect & face);
+
+  // / match the template only around the predicted position, widening the
+  // / window step by step before falling back to detection (default on)
+  void setSearchWindow (bool enabled);
+
+      /** Whether the face of the last frame is being tracked */
+  bool isTracking () const;
+
+  // / normalized correlation of the last template match, 0 if the face is
+  // / not tracked
+  float matchScore () const;
+
+  // / half size in pixels beyond which the window does not grow; 0, the
+  // / default, lets it grow to the whole image
+  void setMaxSearchRadius (int radius);
+
+  // / measured depth of the head in meters; the first depth after a face
+  // / was found fixes the size of the face at that depth, later ones scale
+  // / the template to match
+  void setHeadDepth (float depth);
+
+  // / keep the template at the size the face has at the last head depth
+  // / (default on)
+  void setScaleAdaptive (bool enabled);
+
+private:
+
+  // / template matching in growing windows around the prediction
+  bool matchAround (const Mat & image, double &maxVal, Point & maxLoc);
+
+  // / find a new face with the selected detector
+  bool detect (const Mat & image, Rect & face);
+
+  // / resize the template to the size of the face at the last head depth
+  void scaleTemplate (const Mat & image);
+
+  CascadeClassifier m_cascade;
+  bool m_hasCascade;
+
+  DetectionMode m_detectionMode;
+  DepthHeadDetector m_depthDetector;
+
+  const float *m_coords;
+  const unsigned *m_flags;
+
+  // / true while the template holds a face
+  bool m_tracking;
+  float m_matchScore;
+
+  bool m_searchWindow;
+  int m_maxSearchRadius;
+
+  // / last matched position, its change since the frame before and the
+  // / position expected in the next frame
+  Point m_lastPosition;
+  Point m_velocity;
+  Point m_predicted;
+
+  bool m_scaleAdaptive;
+
+  // / size of the face when it was found and its depth then, 0 until known
+  Size m_referenceSize;
+  float m_referenceDepth;
+
+  // / last measured head depth, 0 if unknown
+  float m_headDepth;
+
+  // / workspaces, allocated when the image or face size changes and
+  // / reused for all other frames
+  Mat m_depthTemplate;
+  Mat m_scaledTemplate;
+  Mat m_matchResult;
+  std::vector < Rect > m_faces;
+};
+
+#endif // HEADTRACKFILTER_HPP_8932408979102
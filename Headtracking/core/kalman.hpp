@@ -0,0 +1,302 @@
+#ifndef KALMAN_HPP_7305186624
+#define KALMAN_HPP_7305186624
+
+#include <string.h>
+#include <math.h>
+
+/** Linear Kalman filter with N states and M measurements.
+ * All matrices live inside the object and the loops have compile time
+ * bounds, so the compiler unrolls them and nothing is allocated. The
+ * members are named like the ones of CvKalman, which it replaces.
+ */
+template < int N, int M >
+class KalmanFilter
+{
+public:
+
+  float transitionMatrix[N][N];
+  float measurementMatrix[M][N];
+  float processNoiseCov[N][N];
+  float measurementNoiseCov[M][M];
+
+      /** Predicted state and error covariance */
+  float statePre[N];
+  float errorCovPre[N][N];
+
+      /** Corrected state and error covariance */
+  float statePost[N];
+  float errorCovPost[N][N];
+
+  KalmanFilter ()
+  {
+    memset (this, 0, sizeof (*this));
+  }
+
+      /** Set the covariances to scaled identities. The state is kept. */
+  void setCovariances (float processNoise, float measurementNoise, float errorCov)
+  {
+    setIdentity (processNoiseCov, processNoise);
+    setIdentity (measurementNoiseCov, measurementNoise);
+    setIdentity (errorCovPost, errorCov);
+    setIdentity (errorCovPre, errorCov);
+  }
+
+      /** Advance the state by one step. Returns the predicted state. */
+  const float *predict ()
+  {
+    // x' = F x
+    for (int i = 0; i < N; ++i)
+      {
+        float s = 0.0f;
+        for (int k = 0; k < N; ++k)
+          {
+            s += transitionMatrix[i][k] * statePost[k];
+          }
+        statePre[i] = s;
+      }
+
+    // P' = F P F^T + Q
+    float fp[N][N];
+    multiply < N, N, N > (transitionMatrix, errorCovPost, fp);
+
+    for (int i = 0; i < N; ++i)
+      {
+        for (int j = 0; j < N; ++j)
+          {
+            float s = processNoiseCov[i][j];
+            for (int k = 0; k < N; ++k)
+              {
+                s += fp[i][k] * transitionMatrix[j][k];
+              }
+            errorCovPre[i][j] = s;
+          }
+      }
+
+    // Without a correction the prediction is the best estimate
+    memcpy (statePost, statePre, sizeof (statePost));
+    memcpy (errorCovPost, errorCovPre, sizeof (errorCovPost));
+
+    return statePre;
+  }
+
+      /** Correct the predicted state with a measurement. Returns false,
+       * leaving the prediction, if the innovation covariance is singular. */
+  bool correct (const float *measurement)
+  {
+    // S = H P' H^T + R
+    float hp[M][N];
+    multiply < M, N, N > (measurementMatrix, errorCovPre, hp);
+
+    float s[M][M];
+    for (int i = 0; i < M; ++i)
+      {
+        for (int j = 0; j < M; ++j)
+          {
+            float v = measurementNoiseCov[i][j];
+            for (int k = 0; k < N; ++k)
+              {
+                v += hp[i][k] * measurementMatrix[j][k];
+              }
+            s[i][j] = v;
+          }
+      }
+
+    float sInv[M][M];
+    if (!invert < M > (s, sInv))
+      {
+        return false;
+      }
+
+    // K = P' H^T S^-1 = (H P')^T S^-1, as P' is symmetric
+    float gain[N][M];
+    for (int i = 0; i < N; ++i)
+      {
+        for (int j = 0; j < M; ++j)
+          {
+            float v = 0.0f;
+            for (int k = 0; k < M; ++k)
+              {
+                v += hp[k][i] * sInv[k][j];
+              }
+            gain[i][j] = v;
+          }
+      }
+
+    // x = x' + K (z - H x')
+    float innovation[M];
+    for (int i = 0; i < M; ++i)
+      {
+        float v = measurement[i];
+        for (int k = 0; k < N; ++k)
+          {
+            v -= measurementMatrix[i][k] * statePre[k];
+          }
+        innovation[i] = v;
+      }
+
+    for (int i = 0; i < N; ++i)
+      {
+        float v = statePre[i];
+        for (int k = 0; k < M; ++k)
+          {
+            v += gain[i][k] * innovation[k];
+          }
+        statePost[i] = v;
+      }
+
+    // P = P' - K H P'
+    for (int i = 0; i < N; ++i)
+      {
+        for (int j = 0; j < N; ++j)
+          {
+            float v = errorCovPre[i][j];
+            for (int k = 0; k < M; ++k)
+              {
+                v -= gain[i][k] * hp[k][j];
+              }
+            errorCovPost[i][j] = v;
+          }
+      }
+
+    return true;
+  }
+
+  template < int R >
+  static void setIdentity (float (&m)[R][R], float value)
+  {
+    for (int i = 0; i < R; ++i)
+      {
+        for (int j = 0; j < R; ++j)
+          {
+            m[i][j] = (i == j) ? value : 0.0f;
+          }
+      }
+  }
+
+private:
+
+      /** c = a b for an R x K and a K x C matrix */
+  template < int R, int K, int C >
+  static void multiply (const float (&a)[R][K], const float (&b)[K][C], float (&c)[R][C])
+  {
+    for (int i = 0; i < R; ++i)
+      {
+        for (int j = 0; j < C; ++j)
+          {
+            float s = 0.0f;
+            for (int k = 0; k < K; ++k)
+              {
+                s += a[i][k] * b[k][j];
+              }
+            c[i][j] = s;
+          }
+      }
+  }
+
+      /** Gauss-Jordan inversion with partial pivoting */
+  template < int R >
+  static bool invert (const float (&m)[R][R], float (&inv)[R][R])
+  {
+    float a[R][R];
+    memcpy (a, m, sizeof (a));
+    setIdentity (inv, 1.0f);
+
+    for (int c = 0; c < R; ++c)
+      {
+        int pivot = c;
+        for (int r = c + 1; r < R; ++r)
+          {
+            if (fabsf (a[r][c]) > fabsf (a[pivot][c]))
+              {
+                pivot = r;
+              }
+          }
+        if (a[pivot][c] == 0.0f)
+          {
+            return false;
+          }
+        if (pivot != c)
+          {
+            for (int k = 0; k < R; ++k)
+              {
+                float t = a[c][k];
+                a[c][k] = a[pivot][k];
+                a[pivot][k] = t;
+                t = inv[c][k];
+                inv[c][k] = inv[pivot][k];
+                inv[pivot][k] = t;
+              }
+          }
+
+        float d = 1.0f / a[c][c];
+        for (int k = 0; k < R; ++k)
+          {
+            a[c][k] *= d;
+            inv[c][k] *= d;
+          }
+
+        for (int r = 0; r < R; ++r)
+          {
+            if (r == c)
+              {
+                continue;
+              }
+            float f = a[r][c];
+            for (int k = 0; k < R; ++k)
+              {
+                a[r][k] -= f * a[c][k];
+                inv[r][k] -= f * inv[c][k];
+              }
+          }
+      }
+
+    return true;
+  }
+};
+
+/** Set up a filter for D measured positions that move with constant
+ * velocity. The state holds the D positions followed by the D velocities.
+ * \param dt Time step of one predict in the unit of the velocities
+ */
+template < int D >
+inline void setConstantVelocity (KalmanFilter < 2 * D, D > &filter, float dt)
+{
+  memset (filter.transitionMatrix, 0, sizeof (filter.transitionMatrix));
+  memset (filter.measurementMatrix, 0, sizeof (filter.measurementMatrix));
+
+  for (int i = 0; i < 2 * D; ++i)
+    {
+      filter.transitionMatrix[i][i] = 1.0f;
+    }
+  for (int i = 0; i < D; ++i)
+    {
+      filter.transitionMatrix[i][D + i] = dt;   // x + dx
+      filter.measurementMatrix[i][i] = 1.0f;
+    }
+}
+
+/** Set up a filter for D measured positions that move with constant
+ * acceleration. The state holds the D positions, the D velocities and the
+ * D accelerations.
+ * \param dt Time step of one predict
+ */
+template < int D >
+inline void setConstantAcceleration (KalmanFilter < 3 * D, D > &filter, float dt)
+{
+  memset (filter.transitionMatrix, 0, sizeof (filter.transitionMatrix));
+  memset (filter.measurementMatrix, 0, sizeof (filter.measurementMatrix));
+
+  for (int i = 0; i < 3 * D; ++i)
+    {
+      filter.transitionMatrix[i][i] = 1.0f;
+    }
+  for (int i = 0; i < D; ++i)
+    {
+      filter.transitionMatrix[i][D + i] = dt;   // x + dx dt
+      filter.transitionMatrix[i][2 * D + i] = 0.5f * dt * dt;   // + ddx dt^2 / 2
+      filter.transitionMatrix[D + i][2 * D + i] = dt;   // dx + ddx dt
+      filter.measurementMatrix[i][i] = 1.0f;
+    }
+}
+
+#endif // KALMAN_HPP_7305186624
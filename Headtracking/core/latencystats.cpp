@@ -0,0 +1,189 @@
+#include "latencystats.hpp"
+#include "atomics.hpp"
+
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+static const char *s_stageNames[STAGE_COUNT] = {
+  "pmdUpdate",
+  "pmdGetSourceData",
+  "pmdCalcAmplitudes",
+  "pmdCalc3DCoordinates",
+  "pmdCalcFlags",
+  "reorient",
+  "temporal filter",
+  "gray image",
+  "findFace detect",
+  "findFace match",
+  "getCoords",
+  "orientation",
+  "Kalman",
+  "tracks",
+  "fusion",
+  "GL paint",
+  "preview",
+  "capture to pose",
+  "frame interval",
+};
+
+LatencyStats::LatencyStats ()
+{
+  for (int i = 0; i < MAX_THREADS; ++i)
+    {
+      m_rings[i] = NULL;
+    }
+  m_claimed = 0;
+
+  pthread_key_create (&m_threadKey, &LatencyStats::threadExited);
+}
+
+LatencyStats::~LatencyStats ()
+{
+  // Threads that exit from now on leave the rings alone
+  pthread_key_delete (m_threadKey);
+
+  for (int i = 0; i < MAX_THREADS; ++i)
+    {
+      delete m_rings[i];
+    }
+}
+
+LatencyStats & LatencyStats::global ()
+{
+  static LatencyStats stats;
+  return stats;
+}
+
+LatencyStats::ThreadRings *LatencyStats::threadRings ()
+{
+  ThreadRings *rings = (ThreadRings *) pthread_getspecific (m_threadKey);
+  if (rings)
+    {
+      return rings;
+    }
+
+  // Rings of an exited thread are taken over first; the acquire makes its
+  // last samples visible before they are written after
+  uint32_t claimed = std::min (loadAcquire (&m_claimed), (uint32_t) MAX_THREADS);
+  for (uint32_t i = 0; i < claimed && !rings; ++i)
+    {
+      ThreadRings *r = loadAcquire (&m_rings[i]);
+      if (r && compareAndSwapAcquire (&r->owned, 0u, 1u))
+        {
+          rings = r;
+        }
+    }
+
+  // A thread that finds all places owned tries again on its next sample,
+  // without counting up m_claimed any further
+  if (!rings && loadRelaxed (&m_claimed) < MAX_THREADS)
+    {
+      uint32_t index = fetchAddRelaxed (&m_claimed, (uint32_t) 1);
+      if (index < MAX_THREADS)
+        {
+          rings = new ThreadRings;
+          memset (rings, 0, sizeof (*rings));
+          rings->owned = 1;
+          storeRelease (&m_rings[index], rings);
+        }
+    }
+
+  if (rings)
+    {
+      pthread_setspecific (m_threadKey, rings);
+    }
+  return rings;
+}
+
+void LatencyStats::threadExited (void *rings)
+{
+  // Publishes the last samples of the thread to the one taking over
+  storeRelease (&((ThreadRings *) rings)->owned, 0u);
+}
+
+void LatencyStats::record (int stage, uint64_t ns)
+{
+  ThreadRings *rings = threadRings ();
+  if (!rings)
+    {
+      return;
+    }
+
+  // Only this thread writes the ring, so the sample is stored before the
+  // count that makes it visible
+  uint32_t n = loadRelaxed (&rings->written[stage]);
+  storeRelaxed (&rings->samples[stage][n % RING_SIZE], (ns > 0xffffffffu) ? 0xffffffffu : (uint32_t) ns);
+  storeRelease (&rings->written[stage], n + 1);
+}
+
+void LatencyStats::summary (int stage, LatencySummary & s) const
+{
+  memset (&s, 0, sizeof (s));
+
+  uint32_t claimed = std::min (loadAcquire (&m_claimed), (uint32_t) MAX_THREADS);
+
+  std::vector < uint32_t > sorted;
+  sorted.reserve (claimed * RING_SIZE);
+
+  for (uint32_t i = 0; i < claimed; ++i)
+    {
+      const ThreadRings *r = loadAcquire (&m_rings[i]);
+      if (!r)
+        {
+          continue;
+        }
+
+      uint32_t n = loadAcquire (&r->written[stage]);
+      uint32_t count = std::min (n - loadRelaxed (&r->cleared[stage]), (uint32_t) RING_SIZE);
+
+      for (uint32_t k = n - count; k != n; ++k)
+        {
+          sorted.push_back (loadRelaxed (&r->samples[stage][k % RING_SIZE]));
+        }
+    }
+
+  unsigned count = sorted.size ();
+  s.count = count;
+
+  if (!count)
+    {
+      return;
+    }
+
+  std::sort (sorted.begin (), sorted.end ());
+
+  s.p50 = sorted[(count - 1) * 50 / 100] / 1000.0;
+  s.p95 = sorted[(count - 1) * 95 / 100] / 1000.0;
+  s.p99 = sorted[(count - 1) * 99 / 100] / 1000.0;
+  s.max = sorted[count - 1] / 1000.0;
+}
+
+void LatencyStats::clear ()
+{
+  // The writers keep counting; the samples before now are just no longer
+  // summarized
+  uint32_t claimed = std::min (loadAcquire (&m_claimed), (uint32_t) MAX_THREADS);
+  for (uint32_t i = 0; i < claimed; ++i)
+    {
+      ThreadRings *r = loadAcquire (&m_rings[i]);
+      if (!r)
+        {
+          continue;
+        }
+
+      for (int stage = 0; stage < STAGE_COUNT; ++stage)
+        {
+          storeRelaxed (&r->cleared[stage], loadAcquire (&r->written[stage]));
+        }
+    }
+}
+
+const char *LatencyStats::stageName (int stage)
+{
+  if (stage < 0 || stage >= STAGE_COUNT)
+    {
+      return "";
+    }
+  return s_stageNames[stage];
+}
@@ -0,0 +1,142 @@
+#ifndef LATENCYSTATS_HPP_2217480953
+#define LATENCYSTATS_HPP_2217480953
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "timestamp.hpp"
+
+/** Processing stages that are timed */
+enum LatencyStage
+{
+  STAGE_UPDATE,                 // pmdUpdate
+  STAGE_SOURCE_DATA,            // pmdGetSourceData and description
+  STAGE_CALC_AMPLITUDES,        // pmdCalcAmplitudes
+  STAGE_CALC_COORDINATES,       // pmdCalc3DCoordinates
+  STAGE_CALC_FLAGS,             // pmdCalcFlags
+  STAGE_REORIENT,               // fused reorientation of the buffers
+  STAGE_TEMPORAL,               // TemporalFilter over the upright buffers
+  STAGE_GRAY,                   // tracking image from the amplitudes
+  STAGE_DETECT,                 // findFace, Haar detection
+  STAGE_MATCH,                  // findFace, template matching
+  STAGE_GET_COORDS,             // head position from the coordinates
+  STAGE_ORIENTATION,            // head orientation from the coordinates
+  STAGE_KALMAN,                 // Kalman predict and correct
+  STAGE_TRACKS,                 // TrackManager matching, all heads in parallel
+  STAGE_FUSION,                 // PoseFusion, poses of several cameras
+  STAGE_PAINT,                  // HeadPerspective::paintGL
+  STAGE_PREVIEW,                // PreviewWidget, tracking image painting
+  STAGE_CAPTURE_TO_POSE,        // frame capture until the pose is known
+  STAGE_FRAME_INTERVAL,         // time between two processed frames
+  STAGE_COUNT
+};
+
+/** Percentiles of the recent samples of one stage in microseconds */
+struct LatencySummary
+{
+  unsigned count;
+  double p50;
+  double p95;
+  double p99;
+  double max;
+};
+
+/** Recent durations of all stages.
+ *
+ * Every thread that records gets its own ring of the last samples per
+ * stage the first time it records, so each ring has a single writer and
+ * recording needs no atomic read-modify-write: the sample is stored, then
+ * the count is published with a release store. Summaries may be taken from
+ * any thread and merge the rings of all threads; they only see samples
+ * that are completely stored. A sample the writer replaces while the
+ * summary copies its ring is counted with the newer value.
+ *
+ * When a thread exits, its rings are handed to the next thread that starts
+ * recording, which goes on writing after the samples already there, so
+ * short lived worker threads do not use up the places. Only while more
+ * than MAX_THREADS threads record at the same time are the samples of the
+ * others not recorded.
+ */
+class LatencyStats
+{
+public:
+
+  enum
+  { RING_SIZE = 512, MAX_THREADS = 32 };
+
+  LatencyStats ();
+  ~LatencyStats ();
+
+      /** Instance used by the application */
+  static LatencyStats & global ();
+
+      /** Add one duration in nanoseconds */
+  void record (int stage, uint64_t ns);
+
+      /** Percentiles over the samples currently in the rings of a stage */
+  void summary (int stage, LatencySummary & s) const;
+
+      /** Forget all samples */
+  void clear ();
+
+  static const char *stageName (int stage);
+
+private:
+
+      /** Samples of one thread */
+  struct ThreadRings
+  {
+        /** 1 while a thread records into the rings, 0 after it exited */
+    volatile uint32_t owned;
+
+    uint32_t samples[STAGE_COUNT][RING_SIZE];
+
+        /** Number of samples ever written per stage, by the thread only */
+    volatile uint32_t written[STAGE_COUNT];
+
+        /** Value of written at the last clear, by the clearing thread
+         * only */
+    volatile uint32_t cleared[STAGE_COUNT];
+  };
+
+      /** Rings of the calling thread, taken over or registered on first
+       * use, NULL if all are owned by other threads */
+  ThreadRings *threadRings ();
+
+      /** Destructor of m_threadKey, frees the rings of an exiting thread */
+  static void threadExited (void *rings);
+
+      /** Rings of the calling thread in this instance */
+  pthread_key_t m_threadKey;
+
+      /** Rings in the order the threads registered, published with a
+       * release store */
+  ThreadRings *volatile m_rings[MAX_THREADS];
+
+      /** Number of places in m_rings claimed so far */
+  volatile uint32_t m_claimed;
+};
+
+/** Records the lifetime of the object as one sample of a stage */
+class StageTimer
+{
+public:
+
+  StageTimer (int stage, LatencyStats & stats = LatencyStats::global ())
+  :m_stats (stats), m_stage (stage), m_start (monotonicNanoseconds ())
+  {
+  }
+
+  ~StageTimer ()
+  {
+    m_stats.record (m_stage, monotonicNanoseconds () - m_start);
+  }
+
+private:
+
+  LatencyStats & m_stats;
+  int m_stage;
+  uint64_t m_start;
+};
+
+#endif // LATENCYSTATS_HPP_2217480953
@@ -0,0 +1,27 @@
+#ifndef POINTSOURCE_HPP_4417092683
+#define POINTSOURCE_HPP_4417092683
+
+/** Calculates the 3D coordinates and flags of the current frame on demand.
+ * Lets the tracker skip the point cloud on frames without a face, and start
+ * it early on frames where the face is expected.
+ */
+class PointSource
+{
+public:
+
+  virtual ~ PointSource ()
+  {
+  }
+
+      /** Hint that points () will be called for this frame. May start the
+       * calculation in the background. */
+  virtual void requestPoints ()
+  {
+  }
+
+      /** Coordinates and flags of the current frame in sensor order.
+       * Returns false if they could not be calculated. */
+  virtual bool points (const float *&coords, const unsigned *&flags) = 0;
+};
+
+#endif // POINTSOURCE_HPP_4417092683
@@ -0,0 +1,239 @@
+#include "posefusion.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+// Closer than this the depth says little about the noise, so the weight
+// stops growing
+static const float s_minDepth = 0.1f;
+
+PoseFusion::PoseFusion (unsigned cameras)
+{
+  CameraExtrinsics identity;
+  memset (&identity, 0, sizeof (identity));
+  identity.rotation[0][0] = 1.0f;
+  identity.rotation[1][1] = 1.0f;
+  identity.rotation[2][2] = 1.0f;
+
+  m_extrinsics.assign (std::max (cameras, 1u), identity);
+  m_latest.resize (m_extrinsics.size ());
+
+  m_maxAgeUs = 50000;
+  m_gate = 0.2f;
+
+  reset ();
+}
+
+unsigned PoseFusion::cameraCount () const
+{
+  return m_extrinsics.size ();
+}
+
+void PoseFusion::setExtrinsics (unsigned camera, const CameraExtrinsics & extrinsics)
+{
+  if (camera < m_extrinsics.size ())
+    {
+      m_extrinsics[camera] = extrinsics;
+    }
+}
+
+const CameraExtrinsics & PoseFusion::extrinsics (unsigned camera) const
+{
+  return m_extrinsics[std::min (camera, cameraCount () - 1)];
+}
+
+bool PoseFusion::loadExtrinsics (const char *fileName)
+{
+  FILE *file = fopen (fileName, "r");
+  if (!file)
+    {
+      return false;
+    }
+
+  char line[512];
+  int lineNumber = 0;
+  bool ok = true;
+
+  while (ok && fgets (line, sizeof (line), file))
+    {
+      ++lineNumber;
+
+      const char *p = line + strspn (line, " \t\r\n");
+      if (*p == '\0' || *p == '#')
+        {
+          continue;
+        }
+
+      unsigned camera;
+      CameraExtrinsics e;
+      float (*r)[3] = e.rotation;
+      float *t = e.translation;
+
+      int n = sscanf (p, "%u %f %f %f %f %f %f %f %f %f %f %f %f", &camera,
+                      &r[0][0], &r[0][1], &r[0][2], &t[0],
+                      &r[1][0], &r[1][1], &r[1][2], &t[1],
+                      &r[2][0], &r[2][1], &r[2][2], &t[2]);
+      if (n != 13 || camera >= m_extrinsics.size ())
+        {
+          fprintf (stderr, "%s:%d: expected a camera number below %u and 12 numbers\n", fileName, lineNumber,
+                   cameraCount ());
+          ok = false;
+          break;
+        }
+
+      m_extrinsics[camera] = e;
+    }
+
+  fclose (file);
+  return ok;
+}
+
+void PoseFusion::setMaxAgeUs (uint64_t us)
+{
+  m_maxAgeUs = us;
+}
+
+void PoseFusion::setGate (float meters)
+{
+  m_gate = meters;
+}
+
+void PoseFusion::reset ()
+{
+  for (size_t i = 0; i < m_latest.size (); ++i)
+    {
+      memset (&m_latest[i].pose, 0, sizeof (HeadPose));
+      m_latest[i].weight = 0.0f;
+      m_latest[i].dt = 0.0f;
+      m_latest[i].recent = false;
+    }
+  memset (m_lastPosition, 0, sizeof (m_lastPosition));
+}
+
+void PoseFusion::transform (unsigned camera, const HeadPose & pose, HeadPose & common) const
+{
+  const CameraExtrinsics & e = m_extrinsics[camera];
+
+  common = pose;
+  for (int i = 0; i < 3; ++i)
+    {
+      common.position[i] = e.translation[i];
+      common.filtered[i] = e.translation[i];
+      common.velocity[i] = 0.0f;
+      for (int k = 0; k < 3; ++k)
+        {
+          common.position[i] += e.rotation[i][k] * pose.position[k];
+          common.filtered[i] += e.rotation[i][k] * pose.filtered[k];
+          common.velocity[i] += e.rotation[i][k] * pose.velocity[k];
+        }
+    }
+}
+
+void PoseFusion::update (unsigned camera, const HeadPose & pose, HeadPose & fused)
+{
+  if (camera >= m_latest.size ())
+    {
+      fused = pose;
+      return;
+    }
+
+  Measurement & m = m_latest[camera];
+  transform (camera, pose, m.pose);
+
+  float depth = std::max (pose.position[2], s_minDepth);
+  m.weight = (pose.state > 0) ? pose.confidence / (depth * depth) : 0.0f;
+
+  // Seconds from each pose to the new one, and the most trusted pose
+  // that is recent enough
+  uint64_t now = pose.timestampUs;
+  int best = -1;
+
+  for (size_t i = 0; i < m_latest.size (); ++i)
+    {
+      Measurement & c = m_latest[i];
+      int64_t age = (int64_t) (now - c.pose.timestampUs);
+
+      c.dt = age * 1e-6f;
+      c.recent = c.weight > 0.0f && (uint64_t) (age < 0 ? -age : age) <= m_maxAgeUs;
+      if (!c.recent)
+        {
+          continue;
+        }
+
+      if (best < 0 || c.weight > m_latest[best].weight)
+        {
+          best = i;
+        }
+    }
+
+  fused = m.pose;
+
+  if (best < 0)
+    {
+      // Nobody there, stay where the last head was
+      memcpy (fused.position, m_lastPosition, sizeof (fused.position));
+      memcpy (fused.filtered, m_lastPosition, sizeof (fused.filtered));
+      memset (fused.velocity, 0, sizeof (fused.velocity));
+      fused.state = 0;
+      fused.confidence = 0.0f;
+      return;
+    }
+
+  float center[3];
+  for (int k = 0; k < 3; ++k)
+    {
+      center[k] = m_latest[best].pose.filtered[k] + m_latest[best].pose.velocity[k] * m_latest[best].dt;
+    }
+
+  float sum = 0.0f;
+  float position[3] = { 0.0f, 0.0f, 0.0f };
+  float filtered[3] = { 0.0f, 0.0f, 0.0f };
+  float velocity[3] = { 0.0f, 0.0f, 0.0f };
+  int state = 0;
+
+  for (size_t i = 0; i < m_latest.size (); ++i)
+    {
+      const Measurement & c = m_latest[i];
+      if (!c.recent)
+        {
+          continue;
+        }
+
+      float moved[3];
+      float distance = 0.0f;
+      for (int k = 0; k < 3; ++k)
+        {
+          moved[k] = c.pose.velocity[k] * c.dt;
+          float d = c.pose.filtered[k] + moved[k] - center[k];
+          distance += d * d;
+        }
+
+      if (distance > m_gate * m_gate)
+        {
+          continue;
+        }
+
+      for (int k = 0; k < 3; ++k)
+        {
+          position[k] += c.weight * (c.pose.position[k] + moved[k]);
+          filtered[k] += c.weight * (c.pose.filtered[k] + moved[k]);
+          velocity[k] += c.weight * c.pose.velocity[k];
+        }
+      sum += c.weight;
+      state = std::max (state, c.pose.state);
+    }
+
+  for (int k = 0; k < 3; ++k)
+    {
+      fused.position[k] = position[k] / sum;
+      fused.filtered[k] = filtered[k] / sum;
+      fused.velocity[k] = velocity[k] / sum;
+    }
+
+  fused.state = state;
+  fused.confidence = m_latest[best].pose.confidence;
+  memcpy (fused.orientation, m_latest[best].pose.orientation, sizeof (fused.orientation));
+
+  memcpy (m_lastPosition, fused.position, sizeof (m_lastPosition));
+}
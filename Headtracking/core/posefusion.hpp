@@ -0,0 +1,99 @@
+#ifndef POSEFUSION_HPP_5521870394
+#define POSEFUSION_HPP_5521870394
+
+#include <vector>
+
+#include "headpose.hpp"
+
+/** Rigid transformation from the upright coordinates of one camera into
+ * the common coordinates of all cameras: common = rotation * camera +
+ * translation, in meters */
+struct CameraExtrinsics
+{
+  float rotation[3][3];
+  float translation[3];
+};
+
+/** Combines the head poses of several cameras into one.
+ * Every camera pose is moved into the common coordinates with the
+ * extrinsics of its camera. A new pose is fused with the latest pose of
+ * every other camera that is recent enough, each extrapolated to the time
+ * of the new one with its velocity. The poses are weighted by their
+ * confidence and by the inverse square of their distance from their
+ * camera, as the depth noise of a time of flight camera grows with the
+ * distance. Poses far from the most trusted one belong to somebody else
+ * and are left out.
+ *
+ * Only the position, the filtered position and the velocity are fused.
+ * The orientation of every camera is relative to the head when that
+ * camera first saw it, so the one of the most trusted pose is kept.
+ */
+class PoseFusion
+{
+public:
+
+      /** Constructor
+       * \param cameras Number of cameras, all with identity extrinsics
+       */
+  PoseFusion (unsigned cameras = 1);
+
+  unsigned cameraCount () const;
+
+  void setExtrinsics (unsigned camera, const CameraExtrinsics & extrinsics);
+  const CameraExtrinsics & extrinsics (unsigned camera) const;
+
+      /** Read the extrinsics of all cameras from a text file. Every line
+       * holds the camera number followed by the 3x4 matrix [rotation |
+       * translation] in rows; empty lines and lines starting with # are
+       * skipped. Cameras not in the file keep their extrinsics. Returns
+       * false if the file is missing or a line cannot be read. */
+  bool loadExtrinsics (const char *fileName);
+
+      /** Longest time in microseconds by which the pose of another camera
+       * may be older than the new one to be fused with it, 50000 by
+       * default */
+  void setMaxAgeUs (uint64_t us);
+
+      /** Largest distance in meters from the most trusted pose at which a
+       * pose is still fused, 0.2 by default */
+  void setGate (float meters);
+
+      /** Fuse the pose of a camera with the latest poses of the others.
+       * \param camera Camera the pose was measured by
+       * \param pose Pose in the coordinates of that camera
+       * \param fused Receives the fused pose in common coordinates, with
+       * the time, frame id and face rectangle of the new pose
+       */
+  void update (unsigned camera, const HeadPose & pose, HeadPose & fused);
+
+      /** Forget the latest poses of all cameras */
+  void reset ();
+
+private:
+
+      /** Latest pose of one camera in common coordinates and its weight,
+       * 0 without a head */
+  struct Measurement
+  {
+    HeadPose pose;
+    float weight;
+
+        /** Seconds from the pose to the one being fused and whether it is
+         * recent enough to be fused with it, set by update */
+    float dt;
+    bool recent;
+  };
+
+  void transform (unsigned camera, const HeadPose & pose, HeadPose & common) const;
+
+  std::vector < CameraExtrinsics > m_extrinsics;
+  std::vector < Measurement > m_latest;
+
+  uint64_t m_maxAgeUs;
+  float m_gate;
+
+      /** Fused position of the last head, kept while there is none */
+  float m_lastPosition[3];
+};
+
+#endif // POSEFUSION_HPP_5521870394
@@ -0,0 +1,192 @@
+#include "posepublisher.hpp"
+#include "timestamp.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+PosePublisher::PosePublisher ()
+{
+  m_ring = NULL;
+  m_name[0] = '\0';
+  m_udpSocket = -1;
+  m_unixSocket = -1;
+  m_dropped = 0;
+  m_published = 0;
+}
+
+PosePublisher::~PosePublisher ()
+{
+  close ();
+}
+
+bool PosePublisher::openShared (const char *name)
+{
+  if (m_ring || strlen (name) >= sizeof (m_name))
+    {
+      return false;
+    }
+
+  int fd = shm_open (name, O_CREAT | O_RDWR, 0644);
+  if (fd < 0)
+    {
+      fprintf (stderr, "Could not create shared memory %s: %s\n", name, strerror (errno));
+      return false;
+    }
+
+  if (ftruncate (fd, sizeof (PoseRing)) != 0)
+    {
+      fprintf (stderr, "Could not size shared memory %s: %s\n", name, strerror (errno));
+      ::close (fd);
+      return false;
+    }
+
+  void *p = mmap (NULL, sizeof (PoseRing), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close (fd);
+
+  if (p == MAP_FAILED)
+    {
+      fprintf (stderr, "Could not map shared memory %s: %s\n", name, strerror (errno));
+      return false;
+    }
+
+  m_ring = (PoseRing *) p;
+  strcpy (m_name, name);
+
+  // Clients wait for the magic, so it is written last
+  storeRelaxed (&m_ring->header.magic, 0u);
+  memset (m_ring->records, 0, sizeof (m_ring->records));
+  m_ring->header.version = POSE_RING_VERSION;
+  m_ring->header.capacity = POSE_RING_CAPACITY;
+  m_ring->header.recordSize = sizeof (PoseRecord);
+  storeRelaxed (&m_ring->header.written, (uint64_t) 0);
+  storeRelease (&m_ring->header.magic, (uint32_t) POSE_RING_MAGIC);
+
+  return true;
+}
+
+bool PosePublisher::openUdp (unsigned short port)
+{
+  if (m_udpSocket >= 0)
+    {
+      return false;
+    }
+
+  int s = socket (AF_INET, SOCK_DGRAM, 0);
+  if (s < 0)
+    {
+      return false;
+    }
+
+  sockaddr_in address;
+  memset (&address, 0, sizeof (address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons (port);
+  address.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+
+  // Connected, so sending does not look up the address every time
+  if (connect (s, (sockaddr *) & address, sizeof (address)) != 0)
+    {
+      ::close (s);
+      return false;
+    }
+
+  m_udpSocket = s;
+  return true;
+}
+
+bool PosePublisher::openUnix (const char *path)
+{
+  if (m_unixSocket >= 0 || strlen (path) >= sizeof (m_unixAddress.sun_path))
+    {
+      return false;
+    }
+
+  int s = socket (AF_UNIX, SOCK_DGRAM, 0);
+  if (s < 0)
+    {
+      return false;
+    }
+
+  memset (&m_unixAddress, 0, sizeof (m_unixAddress));
+  m_unixAddress.sun_family = AF_UNIX;
+  strcpy (m_unixAddress.sun_path, path);
+
+  m_unixSocket = s;
+
+  // The receiver may not be there yet, publish connects again then
+  connectUnix ();
+  return true;
+}
+
+bool PosePublisher::connectUnix ()
+{
+  return connect (m_unixSocket, (sockaddr *) & m_unixAddress, sizeof (m_unixAddress)) == 0;
+}
+
+void PosePublisher::close ()
+{
+  if (m_ring)
+    {
+      munmap (m_ring, sizeof (PoseRing));
+      shm_unlink (m_name);
+      m_ring = NULL;
+    }
+
+  if (m_udpSocket >= 0)
+    {
+      ::close (m_udpSocket);
+      m_udpSocket = -1;
+    }
+
+  if (m_unixSocket >= 0)
+    {
+      ::close (m_unixSocket);
+      m_unixSocket = -1;
+    }
+}
+
+void PosePublisher::publish (const HeadPose & pose, unsigned headId)
+{
+  PoseRecord record;
+  memset (&record, 0, sizeof (record));
+
+  record.publishUs = monotonicMicroseconds ();
+  record.headId = headId;
+  record.confidence = pose.confidence;
+  record.pose = pose;
+
+  record.index = m_ring ? writePoseRecord (m_ring, record) : m_published;
+  ++m_published;
+
+  if (m_udpSocket >= 0 && !send (m_udpSocket, record))
+    {
+      ++m_dropped;
+    }
+
+  if (m_unixSocket >= 0 && !send (m_unixSocket, record))
+    {
+      // A Unix socket receiver that started or restarted after us
+      if (!(errno == ENOTCONN || errno == EDESTADDRREQ || errno == ECONNREFUSED) || !connectUnix () ||
+          !send (m_unixSocket, record))
+        {
+          ++m_dropped;
+        }
+    }
+}
+
+bool PosePublisher::send (int socket, const PoseRecord & record)
+{
+  return ::send (socket, &record, sizeof (record), MSG_DONTWAIT) == (ssize_t) sizeof (record);
+}
+
+unsigned PosePublisher::droppedDatagrams () const
+{
+  return m_dropped;
+}
@@ -0,0 +1,65 @@
+#ifndef POSEPUBLISHER_HPP_3905716248
+#define POSEPUBLISHER_HPP_3905716248
+
+#include <sys/un.h>
+
+#include "posering.hpp"
+
+/** Hands the poses to other processes on the same machine.
+ * Every pose goes into a PoseRing in POSIX shared memory, where clients
+ * read it without a system call, and optionally as one datagram per pose
+ * to a UDP port on localhost, a Unix socket or both, for clients that
+ * would rather wait in poll or select. Publishing never blocks; datagrams
+ * nobody receives are dropped.
+ */
+class PosePublisher
+{
+public:
+
+  PosePublisher ();
+  ~PosePublisher ();
+
+      /** Create the shared memory ring, e.g. "/headtracking". Returns
+       * false if it could not be created. */
+  bool openShared (const char *name);
+
+      /** Also send every pose to a UDP port on 127.0.0.1 */
+  bool openUdp (unsigned short port);
+
+      /** Also send every pose to a Unix datagram socket */
+  bool openUnix (const char *path);
+
+      /** Close the ring and the sockets. The ring is unlinked; clients
+       * that still map it keep their last poses. */
+  void close ();
+
+      /** Publish the pose of a frame. Call from one thread only. */
+  void publish (const HeadPose & pose, unsigned headId = 0);
+
+      /** Number of datagrams that could not be sent */
+  unsigned droppedDatagrams () const;
+
+private:
+
+  bool connectUnix ();
+
+      /** Send a record over a socket, returns false if it was dropped */
+  bool send (int socket, const PoseRecord & record);
+
+  PoseRing *m_ring;
+  char m_name[64];
+
+      /** Sockets of the two transports, -1 if not open */
+  int m_udpSocket;
+  int m_unixSocket;
+
+      /** Where the Unix socket sends to */
+  sockaddr_un m_unixAddress;
+
+  unsigned m_dropped;
+
+      /** Number of poses published so far */
+  uint64_t m_published;
+};
+
+#endif // POSEPUBLISHER_HPP_3905716248
@@ -0,0 +1,113 @@
+#ifndef POSERING_HPP_7742209163
+#define POSERING_HPP_7742209163
+
+#include <stdint.h>
+#include <string.h>
+
+#include "headpose.hpp"
+#include "atomics.hpp"
+
+/** Layout of the shared memory poses are published in, see PosePublisher
+ * and PoseClient.
+ *
+ * The ring has one writer. Every record is guarded by a sequence counter
+ * that is odd while the record is written, so readers never block the
+ * writer and simply try again when they caught a record in the middle of
+ * an update. Reading the latest pose is a few loads and a copy, without
+ * any system call.
+ */
+
+enum
+{
+  POSE_RING_MAGIC = 0x48545031,     // "HTP1"
+  POSE_RING_VERSION = 1,
+
+      /** Number of records, a power of two */
+  POSE_RING_CAPACITY = 64
+};
+
+/** One published pose. Also the payload of the socket stream. */
+struct PoseRecord
+{
+      /** Odd while the record is written */
+  uint64_t sequence;
+
+      /** Running number of the record, 0 for the first */
+  uint64_t index;
+
+      /** Time the record was published in microseconds of the monotonic
+       * clock, comparable with pose.timestampUs */
+  uint64_t publishUs;
+
+      /** Id of the head, see TrackedHead, 0 if only one head is tracked */
+  uint32_t headId;
+
+      /** 0 if no head was found, up to 1 for a head tracked with a good
+       * template match */
+  float confidence;
+
+  HeadPose pose;
+};
+
+struct PoseRingHeader
+{
+      /** POSE_RING_MAGIC once the ring is set up */
+  volatile uint32_t magic;
+  uint32_t version;
+  uint32_t capacity;
+  uint32_t recordSize;
+
+      /** Number of records ever written */
+  volatile uint64_t written;
+};
+
+struct PoseRing
+{
+  PoseRingHeader header;
+  PoseRecord records[POSE_RING_CAPACITY];
+};
+
+/** Append a record and return its running number. Only one thread of one
+ * process may write. */
+inline uint64_t writePoseRecord (PoseRing * ring, const PoseRecord & record)
+{
+  uint64_t n = loadRelaxed (&ring->header.written);
+  PoseRecord *r = &ring->records[n % POSE_RING_CAPACITY];
+
+  uint64_t sequence = loadRelaxed (&r->sequence);
+  storeRelaxed (&r->sequence, sequence + 1);
+
+  // The odd sequence becomes visible before any of the new data
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+
+  memcpy ((char *) r + sizeof (r->sequence), (const char *) &record + sizeof (record.sequence),
+          sizeof (PoseRecord) - sizeof (r->sequence));
+  r->index = n;
+
+  storeRelease (&r->sequence, sequence + 2);
+  storeRelease (&ring->header.written, n + 1);
+  return n;
+}
+
+/** Copy the record with the given running number. Returns false if it was
+ * being written or has already been overwritten; try again or move on. */
+inline bool readPoseRecord (const PoseRing * ring, uint64_t index, PoseRecord & record)
+{
+  const PoseRecord *r = &ring->records[index % POSE_RING_CAPACITY];
+
+  uint64_t before = loadAcquire (&r->sequence);
+  if (before & 1)
+    {
+      return false;
+    }
+
+  memcpy (&record, r, sizeof (PoseRecord));
+
+  // The copy is complete before the sequence is checked again
+  __atomic_thread_fence (__ATOMIC_ACQUIRE);
+
+  uint64_t after = loadRelaxed (&r->sequence);
+  return before == after && before != 0 && record.index == index;
+}
+
+#endif // POSERING_HPP_7742209163
@@ -0,0 +1,173 @@
+#include "reorient.hpp"
+
+#include <string.h>
+
+template < bool Points >
+static void reorientDispatch (unsigned pixelOrigin, unsigned rows, unsigned columns,
+                              const float *srcAmps, const float *srcCoords, const unsigned *srcFlags,
+                              float *amps, float *coords, unsigned *flags, float &maxAmplitude)
+{
+  bool vertical = (pixelOrigin & 0xffff0000) == PMD_DIRECTION_VERTICAL;
+
+  switch (pixelOrigin & 0x00000003)
+    {
+      case PMD_ORIGIN_TOP_RIGHT:
+        if (vertical)
+          reorientBuffers < true, true, false, Points > (rows, columns, srcAmps, srcCoords, srcFlags,
+                                                         amps, coords, flags, maxAmplitude);
+        else
+          reorientBuffers < false, true, false, Points > (rows, columns, srcAmps, srcCoords, srcFlags,
+                                                          amps, coords, flags, maxAmplitude);
+        break;
+      case PMD_ORIGIN_BOTTOM_RIGHT:
+        if (vertical)
+          reorientBuffers < true, true, true, Points > (rows, columns, srcAmps, srcCoords, srcFlags,
+                                                        amps, coords, flags, maxAmplitude);
+        else
+          reorientBuffers < false, true, true, Points > (rows, columns, srcAmps, srcCoords, srcFlags,
+                                                         amps, coords, flags, maxAmplitude);
+        break;
+      case PMD_ORIGIN_BOTTOM_LEFT:
+        if (vertical)
+          reorientBuffers < true, false, true, Points > (rows, columns, srcAmps, srcCoords, srcFlags,
+                                                         amps, coords, flags, maxAmplitude);
+        else
+          reorientBuffers < false, false, true, Points > (rows, columns, srcAmps, srcCoords, srcFlags,
+                                                          amps, coords, flags, maxAmplitude);
+        break;
+      case PMD_ORIGIN_TOP_LEFT:
+      default:
+        if (vertical)
+          reorientBuffers < true, false, false, Points > (rows, columns, srcAmps, srcCoords, srcFlags,
+                                                          amps, coords, flags, maxAmplitude);
+        else
+          reorientBuffers < false, false, false, Points > (rows, columns, srcAmps, srcCoords, srcFlags,
+                                                           amps, coords, flags, maxAmplitude);
+        break;
+    }
+}
+
+unsigned reorientBuffers (unsigned pixelOrigin, unsigned rows, unsigned columns,
+                          const float *srcAmps, const float *srcCoords, const unsigned *srcFlags,
+                          float *amps, float *coords, unsigned *flags, float &maxAmplitude)
+{
+  if (srcCoords)
+    {
+      reorientDispatch < true > (pixelOrigin, rows, columns, srcAmps, srcCoords, srcFlags,
+                                 amps, coords, flags, maxAmplitude);
+    }
+  else
+    {
+      reorientDispatch < false > (pixelOrigin, rows, columns, srcAmps, NULL, NULL, amps, NULL, NULL, maxAmplitude);
+    }
+
+  bool vertical = (pixelOrigin & 0xffff0000) == PMD_DIRECTION_VERTICAL;
+  return vertical ? rows : columns;
+}
+
+void reorientRegion (unsigned pixelOrigin, unsigned rows, unsigned columns,
+                     const float *srcCoords, const unsigned *srcFlags,
+                     int left, int top, int width, int height, float *coords, unsigned *flags)
+{
+  bool vertical = (pixelOrigin & 0xffff0000) == PMD_DIRECTION_VERTICAL;
+  unsigned origin = pixelOrigin & 0x00000003;
+  bool flipX = origin == PMD_ORIGIN_TOP_RIGHT || origin == PMD_ORIGIN_BOTTOM_RIGHT;
+  bool flipY = origin == PMD_ORIGIN_BOTTOM_LEFT || origin == PMD_ORIGIN_BOTTOM_RIGHT;
+
+  const int w = vertical ? rows : columns;
+  const int h = vertical ? columns : rows;
+
+  int x0 = (left < 0) ? 0 : left;
+  int y0 = (top < 0) ? 0 : top;
+  int x1 = (left + width > w) ? w : left + width;
+  int y1 = (top + height > h) ? h : top + height;
+
+  // Inverse of the mapping in reorientBuffers: find the source row i and
+  // column j of every upright pixel
+  for (int y = y0; y < y1; ++y)
+    {
+      for (int x = x0; x < x1; ++x)
+        {
+          int i, j;
+          if (vertical)
+            {
+              i = flipX ? w - 1 - x : x;
+              j = flipY ? h - 1 - y : y;
+            }
+          else
+            {
+              i = flipY ? h - 1 - y : y;
+              j = flipX ? w - 1 - x : x;
+            }
+
+          const float *c = srcCoords + (i * columns + j) * 3;
+          float *dc = coords + (y * w + x) * 3;
+
+          if (vertical)
+            {
+              dc[0] = c[1];
+              dc[1] = -c[0];
+            }
+          else
+            {
+              dc[0] = c[0];
+              dc[1] = c[1];
+            }
+          dc[2] = c[2];
+
+          flags[y * w + x] = srcFlags[i * columns + j];
+        }
+    }
+}
+
+// Approximate base 2 logarithm. Only used for the 8 bit display scaling, so
+// an error of about 1e-4 is irrelevant, and unlike log() it vectorizes.
+static inline float fastLog2 (float v)
+{
+  union
+  {
+    float f;
+    uint32_t i;
+  } vx, mx;
+
+  vx.f = v;
+  mx.i = (vx.i & 0x007fffff) | 0x3f000000;
+
+  float y = (float) vx.i * 1.1920928955078125e-7f;
+
+  return y - 124.22551499f - 1.498030302f * mx.f - 1.72587999f / (0.3520887068f + mx.f);
+}
+
+void amplitudesToGray (const float *amps, unsigned width, unsigned height, float maxAmplitude,
+                       unsigned char *gray, unsigned widthStep)
+{
+  if (maxAmplitude <= 0.0f)
+    {
+      for (unsigned y = 0; y < height; ++y)
+        {
+          memset (gray + y * widthStep, 0, width);
+        }
+      return;
+    }
+
+  const float linScale = 128.0f / maxAmplitude;
+  const float logScale = 128.0f / fastLog2 (1.0f + maxAmplitude);
+
+  for (unsigned y = 0; y < height; ++y)
+    {
+      const float *a = amps + y * width;
+      unsigned char *g = gray + y * widthStep;
+
+      for (unsigned x = 0; x < width; ++x)
+        {
+          float v = a[x];
+          float pos = (v < 0.0f) ? 0.0f : v;
+          float dval = linScale * v + logScale * fastLog2 (1.0f + pos);
+
+          dval = (dval > 255.0f) ? 255.0f : dval;
+          dval = (dval < 0.0f) ? 0.0f : dval;
+
+          g[x] = (unsigned char) dval;
+        }
+    }
+}
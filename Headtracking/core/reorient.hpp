@@ -0,0 +1,112 @@
+#ifndef REORIENT_HPP_5520917364
+#define REORIENT_HPP_5520917364
+
+#include <stdint.h>
+#include <pmdsdk2.h>
+
+/** Fused reorientation of the PMD buffers.
+ * The SDK delivers amplitudes, coordinates and flags in sensor order,
+ * described by the pixel origin of the data description. These functions
+ * bring all three buffers into the upright, top-left origin layout used by
+ * the tracker in one pass over the source data.
+ */
+
+/** Reorient one frame for a fixed direction / origin combination.
+ * \param rows Number of source rows
+ * \param columns Number of source columns
+ * \param maxAmplitude Receives the largest source amplitude
+ * Without Points only the amplitudes are reoriented and the coordinate and
+ * flag pointers are not touched.
+ */
+template < bool Vertical, bool FlipX, bool FlipY, bool Points >
+inline void reorientBuffers (unsigned rows, unsigned columns,
+                             const float *srcAmps, const float *srcCoords, const unsigned *srcFlags,
+                             float *amps, float *coords, unsigned *flags, float &maxAmplitude)
+{
+  // Destination width and height
+  const int w = Vertical ? rows : columns;
+  const int h = Vertical ? columns : rows;
+
+  // Advancing one source column moves right in horizontal layout and down
+  // in vertical layout. The sign follows the origin.
+  const int step = Vertical ? (FlipY ? -w : w) : (FlipX ? -1 : 1);
+
+  float max = 0.0f;
+
+  for (unsigned i = 0; i < rows; ++i)
+    {
+      int x = Vertical ? i : (FlipX ? w - 1 : 0);
+      int y = Vertical ? (FlipY ? h - 1 : 0) : i;
+
+      if (Vertical && FlipX)
+        {
+          x = w - 1 - x;
+        }
+      if (!Vertical && FlipY)
+        {
+          y = h - 1 - y;
+        }
+
+      const float *a = srcAmps + i * columns;
+      const float *c = Points ? srcCoords + i * columns * 3 : NULL;
+      const unsigned *f = Points ? srcFlags + i * columns : NULL;
+
+      float *da = amps + y * w + x;
+      float *dc = Points ? coords + (y * w + x) * 3 : NULL;
+      unsigned *df = Points ? flags + y * w + x : NULL;
+
+      for (int j = 0; j < (int) columns; ++j)
+        {
+          const float v = a[j];
+          max = (v > max) ? v : max;
+
+          da[j * step] = v;
+
+          if (!Points)
+            {
+              continue;
+            }
+
+          df[j * step] = f[j];
+
+          if (Vertical)
+            {
+              dc[j * step * 3 + 0] = c[j * 3 + 1];
+              dc[j * step * 3 + 1] = -c[j * 3 + 0];
+            }
+          else
+            {
+              dc[j * step * 3 + 0] = c[j * 3 + 0];
+              dc[j * step * 3 + 1] = c[j * 3 + 1];
+            }
+          dc[j * step * 3 + 2] = c[j * 3 + 2];
+        }
+    }
+
+  maxAmplitude = max;
+}
+
+/** Select the specialization matching a PMD pixel origin and run it.
+ * If srcCoords is NULL only the amplitudes are reoriented.
+ * \return The destination width; the height follows from the pixel count.
+ */
+unsigned reorientBuffers (unsigned pixelOrigin, unsigned rows, unsigned columns,
+                          const float *srcAmps, const float *srcCoords, const unsigned *srcFlags,
+                          float *amps, float *coords, unsigned *flags, float &maxAmplitude);
+
+/** Reorient the coordinates and flags of an upright rectangle only.
+ * The destination buffers have the full upright size; pixels outside the
+ * rectangle are left alone. The rectangle is clipped to the image.
+ * \param left, top, width, height Rectangle in upright image coordinates
+ */
+void reorientRegion (unsigned pixelOrigin, unsigned rows, unsigned columns,
+                     const float *srcCoords, const unsigned *srcFlags,
+                     int left, int top, int width, int height, float *coords, unsigned *flags);
+
+/** Convert reoriented amplitudes into the log-scaled 8 bit tracking image.
+ * \param widthStep Number of bytes per row of the gray image
+ */
+void amplitudesToGray (const float *amps, unsigned width, unsigned height, float maxAmplitude,
+                       unsigned char *gray, unsigned widthStep);
+
+#endif // REORIENT_HPP_5520917364
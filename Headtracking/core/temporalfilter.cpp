@@ -0,0 +1,170 @@
+#include "temporalfilter.hpp"
+
+#include <pmdsdk2.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+TemporalFilter::TemporalFilter ()
+{
+  m_decay = expf (-1.0f / 4.0f);
+  m_jump = 0.05f;
+  m_amplitudeScale = 200.0f;
+
+  m_pixels = 0;
+  m_amps = NULL;
+  m_coords = NULL;
+  m_weights = NULL;
+}
+
+TemporalFilter::~TemporalFilter ()
+{
+  delete[] m_amps;
+  delete[] m_coords;
+  delete[] m_weights;
+}
+
+void TemporalFilter::setTimeConstant (float frames)
+{
+  m_decay = (frames > 0.0f) ? expf (-1.0f / frames) : 0.0f;
+}
+
+void TemporalFilter::setJumpThreshold (float meters)
+{
+  m_jump = meters;
+}
+
+void TemporalFilter::setAmplitudeScale (float amplitude)
+{
+  m_amplitudeScale = std::max (amplitude, 1e-6f);
+}
+
+void TemporalFilter::reset ()
+{
+  // Without weight the next measurement of every pixel is taken as it is
+  if (m_weights)
+    {
+      memset (m_weights, 0, m_pixels * sizeof (float));
+    }
+}
+
+void TemporalFilter::filter (float *amps, float *coords, const unsigned *flags, unsigned pixels)
+{
+  if (pixels != m_pixels)
+    {
+      delete[] m_amps;
+      delete[] m_coords;
+      delete[] m_weights;
+
+      m_pixels = pixels;
+      m_amps = new float[pixels];
+      m_coords = new float[3 * pixels];
+      m_weights = new float[pixels];
+
+      memset (m_amps, 0, pixels * sizeof (float));
+      memset (m_coords, 0, 3 * pixels * sizeof (float));
+      reset ();
+    }
+
+  unsigned i = 0;
+
+#ifdef __SSE2__
+  const __m128 zero = _mm_setzero_ps ();
+  const __m128 one = _mm_set1_ps (1.0f);
+  const __m128 decay = _mm_set1_ps (m_decay);
+  const __m128 jump = _mm_set1_ps (m_jump);
+  const __m128 scale = _mm_set1_ps (m_amplitudeScale);
+  const __m128 absMask = _mm_castsi128_ps (_mm_set1_epi32 (0x7fffffff));
+  const __m128i inconsistent = _mm_set1_epi32 (PMD_FLAG_INCONSISTENT);
+
+  for (; i + 4 <= pixels; i += 4)
+    {
+      float *c = coords + 3 * i;
+      float *s = m_coords + 3 * i;
+
+      __m128 amp = _mm_loadu_ps (amps + i);
+      __m128i f = _mm_loadu_si128 ((const __m128i *) (flags + i));
+      __m128 consistent = _mm_castsi128_ps (_mm_cmpeq_epi32 (_mm_and_si128 (f, inconsistent), _mm_setzero_si128 ()));
+
+      // Confidence of the new measurements, 0 if they are inconsistent or
+      // dark
+      __m128 conf = _mm_div_ps (amp, _mm_add_ps (amp, scale));
+      conf = _mm_and_ps (_mm_and_ps (consistent, _mm_cmpgt_ps (amp, zero)), conf);
+
+      // Depths of the four pixels, strided by three in the point buffers
+      __m128 z = _mm_set_ps (c[11], c[8], c[5], c[2]);
+      __m128 zs = _mm_set_ps (s[11], s[8], s[5], s[2]);
+      __m128 jumped = _mm_cmpgt_ps (_mm_and_ps (_mm_sub_ps (z, zs), absMask), jump);
+      jumped = _mm_and_ps (jumped, _mm_cmpgt_ps (conf, zero));
+
+      __m128 w = _mm_add_ps (_mm_mul_ps (_mm_loadu_ps (m_weights + i), decay), conf);
+      w = _mm_or_ps (_mm_and_ps (jumped, conf), _mm_andnot_ps (jumped, w));
+      _mm_storeu_ps (m_weights + i, w);
+
+      // Share of the new measurements in the average; pixels that never had
+      // a confident one pass through
+      __m128 known = _mm_cmpgt_ps (w, zero);
+      __m128 g = _mm_or_ps (_mm_and_ps (known, _mm_div_ps (conf, _mm_or_ps (w, _mm_andnot_ps (known, one)))),
+                            _mm_andnot_ps (known, one));
+
+      __m128 sa = _mm_loadu_ps (m_amps + i);
+      sa = _mm_add_ps (sa, _mm_mul_ps (g, _mm_sub_ps (amp, sa)));
+      _mm_storeu_ps (m_amps + i, sa);
+      _mm_storeu_ps (amps + i, sa);
+
+      // Gains of the four pixels spread over their twelve coordinates
+      __m128 g0 = _mm_shuffle_ps (g, g, _MM_SHUFFLE (1, 0, 0, 0));
+      __m128 g1 = _mm_shuffle_ps (g, g, _MM_SHUFFLE (2, 2, 1, 1));
+      __m128 g2 = _mm_shuffle_ps (g, g, _MM_SHUFFLE (3, 3, 3, 2));
+
+      __m128 s0 = _mm_loadu_ps (s);
+      __m128 s1 = _mm_loadu_ps (s + 4);
+      __m128 s2 = _mm_loadu_ps (s + 8);
+      s0 = _mm_add_ps (s0, _mm_mul_ps (g0, _mm_sub_ps (_mm_loadu_ps (c), s0)));
+      s1 = _mm_add_ps (s1, _mm_mul_ps (g1, _mm_sub_ps (_mm_loadu_ps (c + 4), s1)));
+      s2 = _mm_add_ps (s2, _mm_mul_ps (g2, _mm_sub_ps (_mm_loadu_ps (c + 8), s2)));
+      _mm_storeu_ps (s, s0);
+      _mm_storeu_ps (s + 4, s1);
+      _mm_storeu_ps (s + 8, s2);
+      _mm_storeu_ps (c, s0);
+      _mm_storeu_ps (c + 4, s1);
+      _mm_storeu_ps (c + 8, s2);
+    }
+#endif
+
+  filterScalar (amps, coords, flags, i, pixels);
+}
+
+void TemporalFilter::filterScalar (float *amps, float *coords, const unsigned *flags, unsigned begin, unsigned end)
+{
+  for (unsigned i = begin; i < end; ++i)
+    {
+      float *c = coords + 3 * i;
+      float *s = m_coords + 3 * i;
+
+      float amp = amps[i];
+      float conf = ((flags[i] & PMD_FLAG_INCONSISTENT) || amp <= 0.0f) ? 0.0f : amp / (amp + m_amplitudeScale);
+
+      float w = m_weights[i] * m_decay + conf;
+      if (conf > 0.0f && fabsf (c[2] - s[2]) > m_jump)
+        {
+          w = conf;
+        }
+      m_weights[i] = w;
+
+      float g = (w > 0.0f) ? conf / w : 1.0f;
+
+      m_amps[i] += g * (amp - m_amps[i]);
+      amps[i] = m_amps[i];
+
+      for (int k = 0; k < 3; ++k)
+        {
+          s[k] += g * (c[k] - s[k]);
+          c[k] = s[k];
+        }
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef TEMPORALFILTER_HPP_4719306582
+#define TEMPORALFILTER_HPP_4719306582
+
+/** Running average of every pixel over the last frames.
+ * Each pixel keeps its filtered amplitude and point and the weight of the
+ * measurements averaged into them. A new measurement counts with its
+ * confidence, which grows with the amplitude and is 0 for inconsistent
+ * pixels, while the weight of the older ones decays with the time
+ * constant. A pixel whose depth jumps further than the threshold sees
+ * something else now and starts over from the new measurement, so edges
+ * of moving objects do not smear.
+ *
+ * The filter is one streaming pass over the buffers, four pixels at a
+ * time with SSE.
+ */
+class TemporalFilter
+{
+public:
+
+  TemporalFilter ();
+  ~TemporalFilter ();
+
+      /** Number of frames after which a measurement counts e times less
+       * than a new one, 4 by default */
+  void setTimeConstant (float frames);
+
+      /** Depth change in meters from which a pixel starts over, 0.05 by
+       * default */
+  void setJumpThreshold (float meters);
+
+      /** Amplitude at which a measurement counts half as much as a very
+       * bright one, 200 by default */
+  void setAmplitudeScale (float amplitude);
+
+      /** Forget all pixels */
+  void reset ();
+
+      /** Filter the buffers of one frame in place. The state is restarted
+       * when the number of pixels changes.
+       * \param amps Amplitudes
+       * \param coords 3D coordinates in meters
+       * \param flags Flags of the measurements, not changed
+       * \param pixels Number of pixels
+       */
+  void filter (float *amps, float *coords, const unsigned *flags, unsigned pixels);
+
+private:
+
+      /** Filter pixels [begin, end) without SSE */
+  void filterScalar (float *amps, float *coords, const unsigned *flags, unsigned begin, unsigned end);
+
+  float m_decay;
+  float m_jump;
+  float m_amplitudeScale;
+
+  unsigned m_pixels;
+
+      /** Filtered amplitudes and points, and the weight of each pixel */
+  float *m_amps;
+  float *m_coords;
+  float *m_weights;
+};
+
+#endif // TEMPORALFILTER_HPP_4719306582
@@ -0,0 +1,25 @@
+#ifndef TIMESTAMP_HPP_7710294463
+#define TIMESTAMP_HPP_7710294463
+
+#include <stdint.h>
+#include <time.h>
+
+/** Current time of the monotonic clock in microseconds.
+ * All frame and pose timestamps use this clock.
+ */
+inline uint64_t monotonicMicroseconds ()
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/** Current time of the monotonic clock in nanoseconds, for interval timing */
+inline uint64_t monotonicNanoseconds ()
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#endif // TIMESTAMP_HPP_7710294463
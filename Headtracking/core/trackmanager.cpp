@@ -0,0 +1,430 @@
+#include "trackmanager.hpp"
+#include "headtrackfilter.hpp"
+#include "kalman.hpp"
+#include "latencystats.hpp"
+#include "headposition.hpp"
+#include "headregistration.hpp"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// A track follows its face at most this far in pixels from where it is
+// expected, so it does not jump onto the face of somebody else
+static const int s_maxSearchRadius = 32;
+
+// Frames a lost head is kept for, to be found again under its id
+static const unsigned s_maxMissed = 15;
+
+// A detection is only assigned to a lost head whose predicted position is
+// closer than this, in meters or, without points, in face widths
+static const float s_gateMeters = 0.3f;
+static const float s_gateWidths = 1.0f;
+
+struct TrackManager::Track
+{
+  Track ():filter (NULL)
+  {
+  }
+
+  unsigned id;
+  unsigned age;
+
+      /** Frames since the face was last seen */
+  unsigned missed;
+
+      /** Template tracker without a cascade of its own */
+  HeadTrackFilter filter;
+
+      /** Constant velocity in meters and frames */
+  KalmanFilter < 6, 3 > kalman;
+
+  HeadRegistration registration;
+
+  Rect face;
+
+      /** 0 if the face was not seen in this frame, 1 if it was detected,
+       * 2 if it was tracked */
+  int state;
+
+  float position[3];
+
+      /** Prediction for this frame, to associate detections with */
+  float filtered[3];
+};
+
+/** Follows each track of a range into the next frame, by template matching
+ * in the image only or, given the points, by measuring the position of
+ * the matched face. Every track only touches its own state, so the ranges
+ * can run on any thread. */
+class TrackManager::TrackBody:public ParallelLoopBody
+{
+public:
+
+      /** Template matching */
+  TrackBody (Track ** tracks, const Mat & image):m_tracks (tracks), m_image (image), m_match (true),
+    m_amps (NULL), m_coords (NULL), m_flags (NULL)
+  {
+  }
+
+      /** Measurement of the matched faces */
+  TrackBody (Track ** tracks, const Mat & image, const float *amps, const float *coords,
+             const unsigned *flags):m_tracks (tracks), m_image (image), m_match (false), m_amps (amps),
+    m_coords (coords), m_flags (flags)
+  {
+  }
+
+  void operator () (const Range & range) const
+  {
+    for (int i = range.start; i < range.end; ++i)
+      {
+        Track & t = *m_tracks[i];
+
+        if (m_match)
+          {
+            ++t.age;
+            t.state = t.filter.trackFace (m_image, t.face) ? 2 : 0;
+            t.missed = t.state ? 0 : t.missed + 1;
+            continue;
+          }
+
+        const float *prediction = t.kalman.predict ();
+        t.filtered[0] = prediction[0];
+        t.filtered[1] = prediction[1];
+        t.filtered[2] = prediction[2];
+
+        if (t.state && m_coords && estimateHeadPosition (m_amps, m_coords, m_flags, m_image.cols, m_image.rows,
+                                                         t.face.x, t.face.y, t.face.width, t.face.height,
+                                                         t.position))
+          {
+            t.kalman.correct (t.position);
+            t.filter.setHeadDepth (t.position[2]);
+            t.registration.update (m_coords, m_flags, m_image.cols, m_image.rows,
+                                   t.face.x, t.face.y, t.face.width, t.face.height, t.position);
+          }
+      }
+  }
+
+private:
+
+  Track **m_tracks;
+  const Mat & m_image;
+  bool m_match;
+  const float *m_amps;
+  const float *m_coords;
+  const unsigned *m_flags;
+};
+
+TrackManager::TrackManager (const char *cascadeFile)
+{
+  m_maxHeads = 4;
+  m_detectionInterval = 10;
+
+  m_frames = 0;
+  m_nextId = 1;
+  m_tracked = false;
+
+  m_lastTimestampUs = 0;
+  m_frameIntervalUs = 0.0f;
+
+  if (!m_cascade.load (cascadeFile))
+    {
+      printf ("Can't load cascade!\n");
+      exit (-1);
+    }
+
+  m_faces.reserve (16);
+}
+
+TrackManager::~TrackManager ()
+{
+  reset ();
+}
+
+void TrackManager::setMaxHeads (unsigned count)
+{
+  m_maxHeads = std::max (count, 1u);
+}
+
+void TrackManager::setDetectionInterval (unsigned frames)
+{
+  m_detectionInterval = std::max (frames, 1u);
+}
+
+const std::vector < TrackedHead > &TrackManager::heads () const
+{
+  return m_heads;
+}
+
+void TrackManager::reset ()
+{
+  for (size_t i = 0; i < m_tracks.size (); ++i)
+    {
+      delete m_tracks[i];
+    }
+  m_tracks.clear ();
+  m_heads.clear ();
+  m_tracked = false;
+}
+
+void TrackManager::track (const Mat & image)
+{
+  if (!m_tracks.empty ())
+    {
+      StageTimer timer (STAGE_TRACKS);
+      parallel_for_ (Range (0, (int) m_tracks.size ()), TrackBody (&m_tracks[0], image));
+    }
+  m_tracked = true;
+}
+
+Rect TrackManager::trackedRegion () const
+{
+  Rect region;
+  for (size_t i = 0; i < m_tracks.size (); ++i)
+    {
+      if (m_tracks[i]->state)
+        {
+          region = region.area () ? (region | m_tracks[i]->face) : m_tracks[i]->face;
+        }
+    }
+  return region;
+}
+
+bool TrackManager::needsDetection () const
+{
+  bool lost = false;
+  for (size_t i = 0; i < m_tracks.size (); ++i)
+    {
+      lost = lost || m_tracks[i]->missed;
+    }
+
+  return m_tracks.empty () || lost || m_frames % m_detectionInterval == 0;
+}
+
+void TrackManager::update (const Mat & image, const float *amps, const float *coords, const unsigned *flags,
+                           uint64_t timestampUs, unsigned frameId)
+{
+  if (!m_tracked)
+    {
+      track (image);
+    }
+  m_tracked = false;
+
+  if (!m_tracks.empty ())
+    {
+      StageTimer timer (STAGE_GET_COORDS);
+      parallel_for_ (Range (0, (int) m_tracks.size ()), TrackBody (&m_tracks[0], image, amps, coords, flags));
+    }
+
+  if (needsDetection ())
+    {
+      StageTimer timer (STAGE_DETECT);
+      detect (image, amps, coords, flags);
+    }
+  ++m_frames;
+
+  removeTracks ();
+
+  // The filters step once per frame, so their velocity is per frame
+  if (m_lastTimestampUs && timestampUs > m_lastTimestampUs)
+    {
+      float interval = timestampUs - m_lastTimestampUs;
+      m_frameIntervalUs = (m_frameIntervalUs > 0.0f) ? 0.9f * m_frameIntervalUs + 0.1f * interval : interval;
+    }
+  m_lastTimestampUs = timestampUs;
+
+  m_heads.resize (m_tracks.size ());
+  for (size_t i = 0; i < m_tracks.size (); ++i)
+    {
+      const Track & t = *m_tracks[i];
+      TrackedHead & head = m_heads[i];
+      HeadPose & pose = head.pose;
+
+      head.id = t.id;
+      head.age = t.age;
+
+      pose.timestampUs = timestampUs;
+      pose.frameId = frameId;
+      pose.state = t.state;
+      pose.faceLeft = t.state ? t.face.x : 0;
+      pose.faceTop = t.state ? t.face.y : 0;
+      pose.faceWidth = t.state ? t.face.width : 0;
+      pose.faceHeight = t.state ? t.face.height : 0;
+      pose.confidence = (t.state == 2) ? t.filter.matchScore () : 0.5f * t.state;
+
+      // The prediction is kept for associating detections, the pose gets
+      // the corrected state the velocity comes from
+      for (int k = 0; k < 3; ++k)
+        {
+          pose.position[k] = t.position[k];
+          pose.filtered[k] = t.kalman.statePost[k];
+        }
+      velocityPerSecond (t.kalman.statePost + 3, m_frameIntervalUs, pose.velocity);
+
+      if (t.registration.hasOrientation ())
+        {
+          t.registration.orientation (pose.orientation);
+        }
+      else
+        {
+          memset (pose.orientation, 0, sizeof (pose.orientation));
+        }
+    }
+}
+
+void TrackManager::detect (const Mat & image, const float *amps, const float *coords, const unsigned *flags)
+{
+  // All faces in one pass, however many there are
+  m_faces.clear ();
+  m_cascade.detectMultiScale (image, m_faces, 1.2, 2, CV_HAAR_SCALE_IMAGE, Size (12, 12));
+
+  // Lost tracks and detections that may belong to them, nearest first
+  std::vector < std::pair < float, std::pair < int, int > > >pairs;
+  std::vector < float >positions (m_faces.size () * 3);
+  std::vector < bool > used (m_faces.size (), false);
+
+  for (size_t d = 0; d < m_faces.size (); ++d)
+    {
+      const Rect & face = m_faces[d];
+      Point center (face.x + face.width / 2, face.y + face.height / 2);
+      float *position = &positions[d * 3];
+
+      // A face without depth is most likely a picture or a reflection
+      if (coords && !estimateHeadPosition (amps, coords, flags, image.cols, image.rows,
+                                           face.x, face.y, face.width, face.height, position))
+        {
+          used[d] = true;
+          continue;
+        }
+
+      for (size_t i = 0; i < m_tracks.size (); ++i)
+        {
+          const Track & t = *m_tracks[i];
+
+          // Faces that are followed already
+          if (t.state && t.face.contains (center))
+            {
+              used[d] = true;
+              break;
+            }
+          if (t.state)
+            {
+              continue;
+            }
+
+          float distance;
+          if (coords)
+            {
+              float dx = position[0] - t.filtered[0];
+              float dy = position[1] - t.filtered[1];
+              float dz = position[2] - t.filtered[2];
+              distance = sqrtf (dx * dx + dy * dy + dz * dz) / s_gateMeters;
+            }
+          else
+            {
+              float dx = center.x - (t.face.x + t.face.width / 2);
+              float dy = center.y - (t.face.y + t.face.height / 2);
+              distance = sqrtf (dx * dx + dy * dy) / (t.face.width * s_gateWidths);
+            }
+
+          if (distance < 1.0f)
+            {
+              pairs.push_back (std::make_pair (distance, std::make_pair ((int) d, (int) i)));
+            }
+        }
+    }
+
+  std::sort (pairs.begin (), pairs.end ());
+
+  for (size_t p = 0; p < pairs.size (); ++p)
+    {
+      int d = pairs[p].second.first;
+      Track & t = *m_tracks[pairs[p].second.second];
+
+      if (used[d] || t.state)
+        {
+          continue;
+        }
+      used[d] = true;
+
+      // Found again, the filter keeps its state
+      t.filter.startTracking (image, m_faces[d]);
+      t.face = m_faces[d];
+      t.state = 1;
+      t.missed = 0;
+
+      if (coords)
+        {
+          memcpy (t.position, &positions[d * 3], sizeof (t.position));
+          t.kalman.correct (t.position);
+          t.filter.setHeadDepth (t.position[2]);
+        }
+    }
+
+  for (size_t d = 0; d < m_faces.size () && m_tracks.size () < m_maxHeads; ++d)
+    {
+      if (used[d])
+        {
+          continue;
+        }
+
+      Track *t = new Track ();
+      t->id = m_nextId++;
+      t->age = 0;
+      t->missed = 0;
+      t->state = 1;
+      t->face = m_faces[d];
+
+      t->filter.setMaxSearchRadius (s_maxSearchRadius);
+      t->filter.startTracking (image, t->face);
+
+      // Same noise as the single head filter of HeadTracker, in meters
+      setConstantVelocity < 3 > (t->kalman, 1.0f);
+      t->kalman.setCovariances (1e-3f * 1e-6f, 5e+1f * 1e-6f, 1e-6f);
+
+      memset (t->position, 0, sizeof (t->position));
+      if (coords)
+        {
+          memcpy (t->position, &positions[d * 3], sizeof (t->position));
+          t->filter.setHeadDepth (t->position[2]);
+        }
+
+      // Start at the face instead of converging from the origin
+      memcpy (t->kalman.statePost, t->position, sizeof (t->position));
+      memcpy (t->filtered, t->position, sizeof (t->position));
+
+      m_tracks.push_back (t);
+    }
+}
+
+void TrackManager::removeTracks ()
+{
+  size_t kept = 0;
+
+  for (size_t i = 0; i < m_tracks.size (); ++i)
+    {
+      Track *t = m_tracks[i];
+      bool remove = t->missed > s_maxMissed;
+
+      // Two templates that ended up on the same face; the older track wins
+      for (size_t j = 0; j < kept && !remove && t->state; ++j)
+        {
+          const Track *older = m_tracks[j];
+          Rect overlap = older->face & t->face;
+          remove = older->state && overlap.area () * 2 > std::min (older->face.area (), t->face.area ());
+        }
+
+      if (remove)
+        {
+          delete t;
+        }
+      else
+        {
+          m_tracks[kept++] = t;
+        }
+    }
+
+  m_tracks.resize (kept);
+}
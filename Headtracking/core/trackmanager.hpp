@@ -0,0 +1,112 @@
+#ifndef TRACKMANAGER_HPP_5519027461
+#define TRACKMANAGER_HPP_5519027461
+
+#include <vector>
+#include <stdint.h>
+
+#include <opencv/cxcore.h>
+#include <opencv/cv.h>
+
+#include "headpose.hpp"
+
+using namespace cv;
+
+/** Tracks the heads of everybody in front of the camera.
+ * Every head has its own template, search window and Kalman filter, and
+ * the heads are followed in parallel, each only within its own window. A
+ * single cascade pass over the whole image looks for new heads every few
+ * frames, so the cost of a head does not grow with the number of heads.
+ * Detections are assigned to the lost head with the nearest predicted
+ * position in space, so a head that was hidden keeps its id.
+ */
+class TrackManager
+{
+public:
+
+      /** Constructor
+       * \param cascadeFile Haar cascade used to detect new faces
+       */
+  TrackManager (const char *cascadeFile = "haarcascade_frontalface_alt.xml");
+
+      /** Destructor */
+  ~TrackManager ();
+
+      /** Maximum number of heads tracked at once, 4 by default */
+  void setMaxHeads (unsigned count);
+
+      /** Look for new heads every this many frames, 10 by default. While
+       * nobody or a lost head is tracked it looks in every frame. */
+  void setDetectionInterval (unsigned frames);
+
+      /** First half of update: follow the heads into the next image by
+       * template matching, which needs no points. trackedRegion and
+       * needsDetection then tell which points update will use. Called by
+       * update if it was not called before.
+       */
+  void track (const Mat & image);
+
+      /** Bounding rectangle of the faces found by track, empty if none */
+  Rect trackedRegion () const;
+
+      /** Whether update will look for new heads in this frame, and so
+       * needs the points of the whole image */
+  bool needsDetection () const;
+
+      /** Follow the heads into the next frame: match them unless track
+       * did already, measure their positions and look for new heads.
+       * \param image Upright tracking image
+       * \param amps Upright amplitudes, weighting the points
+       * \param coords Upright coordinates in meters, NULL if there are
+       * none; heads are then associated in the image. Only needed within
+       * trackedRegion unless needsDetection.
+       * \param flags Upright flags
+       * \param timestampUs Capture time of the frame
+       * \param frameId Frame number, copied into the poses
+       */
+  void update (const Mat & image, const float *amps, const float *coords, const unsigned *flags,
+               uint64_t timestampUs, unsigned frameId);
+
+      /** Heads of the last frame, the longest tracked first. Heads that
+       * are lost but may still be found again have a state of 0. */
+  const std::vector < TrackedHead > &heads () const;
+
+      /** Forget all heads */
+  void reset ();
+
+private:
+
+  struct Track;
+  class TrackBody;
+
+      /** Look for faces no track follows and start or resume tracks */
+  void detect (const Mat & image, const float *amps, const float *coords, const unsigned *flags);
+
+      /** Drop lost tracks and tracks that ended up on the face of another */
+  void removeTracks ();
+
+  CascadeClassifier m_cascade;
+
+  unsigned m_maxHeads;
+  unsigned m_detectionInterval;
+
+  unsigned m_frames;
+  unsigned m_nextId;
+
+      /** Whether track was called for the frame update is waiting for */
+  bool m_tracked;
+
+      /** Capture time of the last frame and the smoothed time between two
+       * frames, to convert the velocities to meters per second */
+  uint64_t m_lastTimestampUs;
+  float m_frameIntervalUs;
+
+      /** Oldest first, owned */
+  std::vector < Track * >m_tracks;
+
+  std::vector < TrackedHead > m_heads;
+
+      /** Workspace of detect */
+  std::vector < Rect > m_faces;
+};
+
+#endif // TRACKMANAGER_HPP_5519027461
@@ -0,0 +1,250 @@
+#include "framefile.hpp"
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static inline uint64_t align16 (uint64_t v)
+{
+  return (v + 15) & ~(uint64_t) 15;
+}
+
+// Offsets of the blocks of a record relative to its start
+static inline uint64_t sourceOffset ()
+{
+  return align16 (sizeof (RecordedFrame));
+}
+
+static inline uint64_t amplitudesOffset (const RecordedFrame * f)
+{
+  return sourceOffset () + align16 (f->sourceSize);
+}
+
+static inline uint64_t coordinatesOffset (const RecordedFrame * f)
+{
+  return amplitudesOffset (f) + align16 ((uint64_t) f->pixels * sizeof (float));
+}
+
+static inline uint64_t flagsOffset (const RecordedFrame * f)
+{
+  return coordinatesOffset (f) + align16 ((uint64_t) f->pixels * 3 * sizeof (float));
+}
+
+static inline uint64_t recordSize (const RecordedFrame * f)
+{
+  return flagsOffset (f) + align16 ((uint64_t) f->pixels * sizeof (unsigned));
+}
+
+FrameRecorder::FrameRecorder ()
+{
+  m_file = NULL;
+  m_offset = 0;
+}
+
+FrameRecorder::~FrameRecorder ()
+{
+  close ();
+}
+
+bool FrameRecorder::open (const char *fileName)
+{
+  close ();
+
+  m_file = fopen (fileName, "wb");
+  if (!m_file)
+    {
+      return false;
+    }
+
+  m_offset = 0;
+  m_index.clear ();
+
+  // Header is rewritten with the final values on close
+  RecordingHeader header;
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, RECORDING_MAGIC, sizeof (header.magic));
+  header.version = RECORDING_VERSION;
+
+  return writeBlock (&header, sizeof (header));
+}
+
+void FrameRecorder::close ()
+{
+  if (!m_file)
+    {
+      return;
+    }
+
+  RecordingHeader header;
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, RECORDING_MAGIC, sizeof (header.magic));
+  header.version = RECORDING_VERSION;
+  header.frameCount = m_index.size ();
+  header.indexOffset = m_offset;
+
+  if (!m_index.empty ())
+    {
+      fwrite (&m_index[0], sizeof (uint64_t), m_index.size (), m_file);
+    }
+
+  fseek (m_file, 0, SEEK_SET);
+  fwrite (&header, sizeof (header), 1, m_file);
+
+  fclose (m_file);
+  m_file = NULL;
+}
+
+bool FrameRecorder::isOpen () const
+{
+  return m_file != NULL;
+}
+
+bool FrameRecorder::write (const PMDDataDescription & dd, const void *source, size_t sourceSize,
+                           uint64_t timestampUs, unsigned frameId,
+                           const float *amplitudes, const float *coordinates, const unsigned *flags)
+{
+  if (!m_file)
+    {
+      return false;
+    }
+
+  RecordedFrame frame;
+  memset (&frame, 0, sizeof (frame));
+  frame.frameId = frameId;
+  frame.pixels = dd.img.numRows * dd.img.numColumns;
+  frame.timestampUs = timestampUs;
+  frame.sourceSize = sourceSize;
+  frame.dd = dd;
+
+  uint64_t start = m_offset;
+
+  if (!writeBlock (&frame, sizeof (frame)) ||
+      !writeBlock (source, sourceSize) ||
+      !writeBlock (amplitudes, frame.pixels * sizeof (float)) ||
+      !writeBlock (coordinates, frame.pixels * 3 * sizeof (float)) ||
+      !writeBlock (flags, frame.pixels * sizeof (unsigned)))
+    {
+      return false;
+    }
+
+  m_index.push_back (start);
+  return true;
+}
+
+bool FrameRecorder::writeBlock (const void *data, size_t size)
+{
+  static const char padding[16] = { 0 };
+
+  size_t padded = align16 (size);
+
+  if (fwrite (data, 1, size, m_file) != size || fwrite (padding, 1, padded - size, m_file) != padded - size)
+    {
+      return false;
+    }
+
+  m_offset += padded;
+  return true;
+}
+
+FrameFile::FrameFile ()
+{
+  m_map = NULL;
+  m_size = 0;
+  m_index = NULL;
+  m_frameCount = 0;
+}
+
+FrameFile::~FrameFile ()
+{
+  close ();
+}
+
+bool FrameFile::open (const char *fileName)
+{
+  close ();
+
+  int fd =::open (fileName, O_RDONLY);
+  if (fd < 0)
+    {
+      return false;
+    }
+
+  struct stat st;
+  if (fstat (fd, &st) != 0 || (size_t) st.st_size < sizeof (RecordingHeader))
+    {
+      ::close (fd);
+      return false;
+    }
+
+  // Private writable mapping: consumers get non-const buffers like from the
+  // SDK, pages are only copied if somebody actually writes to them
+  void *map = mmap (NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  ::close (fd);
+
+  if (map == MAP_FAILED)
+    {
+      return false;
+    }
+
+  m_map = (unsigned char *) map;
+  m_size = st.st_size;
+
+  const RecordingHeader *header = (const RecordingHeader *) m_map;
+
+  if (memcmp (header->magic, RECORDING_MAGIC, sizeof (header->magic)) != 0 ||
+      header->version != RECORDING_VERSION ||
+      header->indexOffset + (uint64_t) header->frameCount * sizeof (uint64_t) > m_size)
+    {
+      close ();
+      return false;
+    }
+
+  m_index = (const uint64_t *) (m_map + header->indexOffset);
+  m_frameCount = header->frameCount;
+
+  for (unsigned i = 0; i < m_frameCount; ++i)
+    {
+      if (m_index[i] + sizeof (RecordedFrame) > header->indexOffset ||
+          m_index[i] + recordSize ((const RecordedFrame *) (m_map + m_index[i])) > header->indexOffset)
+        {
+          close ();
+          return false;
+        }
+    }
+
+  madvise (m_map, m_size, MADV_SEQUENTIAL);
+
+  return true;
+}
+
+void FrameFile::close ()
+{
+  if (m_map)
+    {
+      munmap (m_map, m_size);
+    }
+
+  m_map = NULL;
+  m_size = 0;
+  m_index = NULL;
+  m_frameCount = 0;
+}
+
+unsigned FrameFile::frameCount () const
+{
+  return m_frameCount;
+}
+
+void FrameFile::frame (unsigned i, RecordedFrameView & view) const
+{
+  unsigned char *record = m_map + m_index[i];
+  const RecordedFrame *f = (const RecordedFrame *) record;
+
+  view.header = f;
+  view.source = record + sourceOffset ();
+  view.amplitudes = (float *) (record + amplitudesOffset (f));
+  view.coordinates = (float *) (record + coordinatesOffset (f));
+  view.flags = (unsigned *) (record + flagsOffset (f));
+}
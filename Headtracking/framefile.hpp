@@ -0,0 +1,111 @@
+#ifndef FRAMEFILE_HPP_2096618372
+#define FRAMEFILE_HPP_2096618372
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <pmdsdk2.h>
+
+/** Frame recordings.
+ *
+ * A recording starts with a RecordingHeader, followed by one record per
+ * frame and an index of record offsets at the end of the file. Each record
+ * is a RecordedFrame header followed by the raw source data and the
+ * amplitude, coordinate and flag buffers as calculated by the SDK, in
+ * sensor order. Every block starts on a 16 byte boundary so the buffers
+ * can be used in place from a mapping of the file.
+ */
+
+#define RECORDING_MAGIC "PMDREC\0\0"
+#define RECORDING_VERSION 1
+
+struct RecordingHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t frameCount;
+  uint64_t indexOffset;
+};
+
+struct RecordedFrame
+{
+  uint32_t frameId;
+
+      /** Number of pixels, i.e. rows * columns */
+  uint32_t pixels;
+
+  uint64_t timestampUs;
+  uint64_t sourceSize;
+
+  PMDDataDescription dd;
+};
+
+/** Pointers to one frame inside a mapped recording */
+struct RecordedFrameView
+{
+  const RecordedFrame *header;
+  unsigned char *source;
+  float *amplitudes;
+  float *coordinates;
+  unsigned *flags;
+};
+
+/** Writes a recording with buffered stdio. */
+class FrameRecorder
+{
+public:
+
+  FrameRecorder ();
+  ~FrameRecorder ();
+
+      /** Create the file. Returns false if it cannot be opened. */
+  bool open (const char *fileName);
+
+      /** Write the index and close the file */
+  void close ();
+
+  bool isOpen () const;
+
+      /** Append one frame. Buffers are in sensor order as returned by the SDK. */
+  bool write (const PMDDataDescription & dd, const void *source, size_t sourceSize,
+              uint64_t timestampUs, unsigned frameId,
+              const float *amplitudes, const float *coordinates, const unsigned *flags);
+
+private:
+
+  bool writeBlock (const void *data, size_t size);
+
+  FILE *m_file;
+  uint64_t m_offset;
+  std::vector < uint64_t > m_index;
+};
+
+/** Read-only memory mapping of a recording.
+ * Frames are accessed in place, nothing is copied.
+ */
+class FrameFile
+{
+public:
+
+  FrameFile ();
+  ~FrameFile ();
+
+      /** Map the file and check header and index */
+  bool open (const char *fileName);
+  void close ();
+
+  unsigned frameCount () const;
+
+      /** Get the pointers of frame i */
+  void frame (unsigned i, RecordedFrameView & view) const;
+
+private:
+
+  unsigned char *m_map;
+  size_t m_size;
+
+  const uint64_t *m_index;
+  unsigned m_frameCount;
+};
+
+#endif // FRAMEFILE_HPP_2096618372
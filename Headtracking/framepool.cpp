@@ -0,0 +1,249 @@
+#include "framepool.hpp"
+
+#include <string.h>
+
+// Qt 4 atomics have no plain acquire load or release store, so use the
+// ordered read-modify-write operations with the matching semantics.
+static inline unsigned loadAcquire (QAtomicInt & v)
+{
+  return (unsigned) v.fetchAndAddAcquire (0);
+}
+
+static inline void storeRelease (QAtomicInt & v, unsigned value)
+{
+  v.fetchAndStoreRelease ((int) value);
+}
+
+void FrameSlot::reserve (size_t size)
+{
+  if (size > capacity)
+    {
+      delete[]buffer;
+      buffer = new unsigned char[size];
+      capacity = size;
+    }
+  data = buffer;
+}
+
+void FrameSlot::reserveBuffers (unsigned pixels)
+{
+  if (pixels > calcPixels)
+    {
+      delete[]calcAmplitudes;
+      delete[]calcCoordinates;
+      delete[]calcFlags;
+      calcAmplitudes = new float[pixels];
+      calcCoordinates = new float[pixels * 3];
+      calcFlags = new unsigned[pixels];
+      calcPixels = pixels;
+    }
+  amplitudes = calcAmplitudes;
+  coordinates = calcCoordinates;
+  flags = calcFlags;
+}
+
+void FrameSlot::reserveGray (unsigned width, unsigned height)
+{
+  if ((size_t) width * height > grayCapacity)
+    {
+      delete[]gray;
+      grayCapacity = (size_t) width * height;
+      gray = new unsigned char[grayCapacity];
+    }
+  grayWidth = width;
+  grayHeight = height;
+}
+
+FrameRing::FrameRing (unsigned capacity)
+{
+  m_size = 1;
+  while (m_size < capacity)
+    {
+      m_size <<= 1;
+    }
+
+  m_ring = new FrameSlot *[m_size];
+  memset (m_ring, 0, m_size * sizeof (FrameSlot *));
+
+  m_head = 0;
+  m_tail = 0;
+}
+
+FrameRing::~FrameRing ()
+{
+  delete[]m_ring;
+}
+
+bool FrameRing::push (FrameSlot * slot)
+{
+  unsigned tail = (unsigned) (int) m_tail;
+  unsigned head = loadAcquire (m_head);
+
+  if (tail - head >= m_size)
+    {
+      return false;
+    }
+
+  m_ring[tail & (m_size - 1)] = slot;
+  storeRelease (m_tail, tail + 1);
+  return true;
+}
+
+FrameSlot *FrameRing::pop ()
+{
+  unsigned head = (unsigned) (int) m_head;
+  unsigned tail = loadAcquire (m_tail);
+
+  if (head == tail)
+    {
+      return NULL;
+    }
+
+  FrameSlot *slot = m_ring[head & (m_size - 1)];
+  storeRelease (m_head, head + 1);
+  return slot;
+}
+
+FramePool::FramePool (unsigned slots):m_free (slots), m_ready (slots), m_freeCount (slots)
+{
+  m_slotCount = slots;
+  m_slots = new FrameSlot[m_slotCount];
+  m_policy = DELIVERY_FIFO;
+  m_mailbox = NULL;
+  m_spare = NULL;
+  m_nextId = 0;
+  m_dropped = 0;
+  m_replaced = 0;
+
+  for (unsigned i = 0; i < m_slotCount; ++i)
+    {
+      memset (&m_slots[i].dd, 0, sizeof (PMDDataDescription));
+      m_slots[i].data = NULL;
+      m_slots[i].dataSize = 0;
+      m_slots[i].buffer = NULL;
+      m_slots[i].capacity = 0;
+      m_slots[i].amplitudes = NULL;
+      m_slots[i].coordinates = NULL;
+      m_slots[i].flags = NULL;
+      m_slots[i].calcAmplitudes = NULL;
+      m_slots[i].calcCoordinates = NULL;
+      m_slots[i].calcFlags = NULL;
+      m_slots[i].calcPixels = 0;
+      memset (&m_slots[i].pose, 0, sizeof (HeadPose));
+      m_slots[i].gray = NULL;
+      m_slots[i].grayWidth = 0;
+      m_slots[i].grayHeight = 0;
+      m_slots[i].grayCapacity = 0;
+      m_slots[i].timestampUs = 0;
+      m_slots[i].integrationUs = 0;
+      m_slots[i].frameId = 0;
+      m_slots[i].camera = 0;
+
+      m_free.push (&m_slots[i]);
+    }
+}
+
+FramePool::~FramePool ()
+{
+  for (unsigned i = 0; i < m_slotCount; ++i)
+    {
+      delete[]m_slots[i].buffer;
+      delete[]m_slots[i].calcAmplitudes;
+      delete[]m_slots[i].calcCoordinates;
+      delete[]m_slots[i].calcFlags;
+      delete[]m_slots[i].gray;
+    }
+  delete[]m_slots;
+}
+
+void FramePool::setPolicy (DeliveryPolicy policy)
+{
+  m_policy = policy;
+}
+
+DeliveryPolicy FramePool::policy () const
+{
+  return m_policy;
+}
+
+FrameSlot *FramePool::acquire (int timeoutMs)
+{
+  if (m_spare)
+    {
+      FrameSlot *slot = m_spare;
+      m_spare = NULL;
+      return slot;
+    }
+
+  // One count per slot in the ring, so a successful acquire always finds
+  // one there
+  if (!m_freeCount.tryAcquire (1, timeoutMs))
+    {
+      return NULL;
+    }
+  return m_free.pop ();
+}
+
+void FramePool::publish (FrameSlot * slot)
+{
+  slot->frameId = m_nextId++;
+
+  if (m_policy == DELIVERY_FIFO)
+    {
+      m_ready.push (slot);
+      return;
+    }
+
+  // The frame in the mailbox, if any, was never taken and is stale now
+  FrameSlot *stale = m_mailbox.fetchAndStoreOrdered (slot);
+  if (stale)
+    {
+      m_spare = stale;
+      m_replaced.fetchAndAddRelaxed (1);
+    }
+}
+
+void FramePool::dropFrame ()
+{
+  ++m_nextId;
+  m_dropped.fetchAndAddRelaxed (1);
+}
+
+FrameSlot *FramePool::next ()
+{
+  if (m_policy == DELIVERY_FIFO)
+    {
+      return m_ready.pop ();
+    }
+  return m_mailbox.fetchAndStoreOrdered (NULL);
+}
+
+void FramePool::release (FrameSlot * slot)
+{
+  m_free.push (slot);
+  m_freeCount.release ();
+}
+
+unsigned FramePool::framesInFlight () const
+{
+  // A replaced frame waits for the producer, not for the consumer
+  return m_slotCount - m_freeCount.available () - (m_spare ? 1 : 0);
+}
+
+unsigned FramePool::droppedFrames () const
+{
+  return (unsigned) (int) m_dropped;
+}
+
+unsigned FramePool::replacedFrames () const
+{
+  return (unsigned) (int) m_replaced;
+}
+
+void FramePool::setCamera (unsigned camera)
+{
+  for (unsigned i = 0; i < m_slotCount; ++i)
+    {
+      m_slots[i].camera = camera;
+    }
+}
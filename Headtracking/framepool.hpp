@@ -0,0 +1,224 @@
+#ifndef FRAMEPOOL_HPP_3378120945
+#define FRAMEPOOL_HPP_3378120945
+
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QSemaphore>
+#include <stdint.h>
+#include <vector>
+#include <pmdsdk2.h>
+
+#include "headpose.hpp"
+
+/** One reusable frame.
+ * Holds the data description and the raw source data of a frame. The owned
+ * buffer is only reallocated when a frame does not fit into it, so it is
+ * never touched by the allocator in steady state.
+ */
+struct FrameSlot
+{
+  PMDDataDescription dd;
+
+      /** Raw source data. Points to buffer, or into memory owned by the
+       * frame source (e.g. a mapped recording). */
+  unsigned char *data;
+
+      /** Number of valid bytes in data */
+  size_t dataSize;
+
+      /** Buffer owned by the slot */
+  unsigned char *buffer;
+
+      /** Number of bytes allocated for buffer */
+  size_t capacity;
+
+      /** Amplitudes, coordinates and flags in sensor order. Set by the
+       * source if it already provides them (e.g. a recording), NULL if
+       * they have to be calculated from the source data. */
+  float *amplitudes;
+  float *coordinates;
+  unsigned *flags;
+
+      /** Buffers owned by the slot for calculated amplitudes, coordinates
+       * and flags, with room for calcPixels pixels */
+  float *calcAmplitudes;
+  float *calcCoordinates;
+  unsigned *calcFlags;
+  unsigned calcPixels;
+
+      /** Result of tracking this frame */
+  HeadPose pose;
+
+      /** All heads of this frame when several are tracked, see
+       * HeadTracker::setMaxHeads. Keeps its capacity between frames. */
+  std::vector < TrackedHead > heads;
+
+      /** Copy of the tracking image for presentation */
+  unsigned char *gray;
+  unsigned grayWidth;
+  unsigned grayHeight;
+  size_t grayCapacity;
+
+      /** Capture time in microseconds of the monotonic clock */
+  uint64_t timestampUs;
+
+      /** Integration time the frame was taken with in microseconds, 0 if
+       * unknown */
+  unsigned integrationUs;
+
+      /** Running number assigned by the producer */
+  unsigned frameId;
+
+      /** Number of the camera the frame comes from, see
+       * FramePool::setCamera */
+  unsigned camera;
+
+      /** Point data to the owned buffer, which can hold at least size bytes */
+  void reserve (size_t size);
+
+      /** Point amplitudes, coordinates and flags to the owned buffers,
+       * which can hold at least pixels pixels */
+  void reserveBuffers (unsigned pixels);
+
+      /** Make gray hold an image of the given size */
+  void reserveGray (unsigned width, unsigned height);
+};
+
+/** Lock-free ring of frame slots for exactly one producer and one consumer
+ * thread. Push may only be called by the producer, pop only by the consumer.
+ */
+class FrameRing
+{
+public:
+
+      /** Constructor
+       * \param capacity Maximum number of slots in the ring
+       */
+  FrameRing (unsigned capacity);
+
+      /** Destructor */
+  ~FrameRing ();
+
+      /** Append a slot. Returns false if the ring is full. */
+  bool push (FrameSlot * slot);
+
+      /** Remove the oldest slot. Returns NULL if the ring is empty. */
+  FrameSlot *pop ();
+
+private:
+
+  FrameSlot **m_ring;
+
+      /** Ring size, a power of two */
+  unsigned m_size;
+
+      /** Next position to pop, written by the consumer only */
+  QAtomicInt m_head;
+
+      /** Next position to push, written by the producer only */
+  QAtomicInt m_tail;
+};
+
+/** How published frames wait for the consumer */
+enum DeliveryPolicy
+{
+      /** In a mailbox for one frame; a new frame replaces one the consumer
+       * has not taken yet. The consumer always gets the newest frame. */
+  DELIVERY_LATEST,
+
+      /** In order in a queue as long as the pool, e.g. for recording; the
+       * consumer gets every frame that found a slot */
+  DELIVERY_FIFO
+};
+
+/** Fixed set of frame slots passed between the acquisition thread and the
+ * processing thread.
+ *
+ * The producer takes a free slot, fills it and publishes it. The consumer
+ * takes published slots and releases them when done. Both directions are
+ * lock-free, so neither side allocates, and the producer only sleeps when
+ * it asks to wait for a free slot.
+ *
+ * Overflow policy: when all slots are in flight the producer gets no slot.
+ * It is expected to drop the frame it just read from the device and count
+ * it with dropFrame (), so the consumer only ever sees the frames that fit
+ * into the pool and never waits on a backlog of stale frames. With
+ * DELIVERY_LATEST a frame the consumer did not take in time is replaced
+ * and counted as well, and its slot goes straight back to the producer.
+ */
+class FramePool
+{
+public:
+
+      /** Constructor
+       * \param slots Number of frames that can be in flight at once
+       */
+  FramePool (unsigned slots);
+
+      /** Destructor */
+  ~FramePool ();
+
+      /** Select the delivery policy, DELIVERY_FIFO by default. Call before
+       * the producer starts. */
+  void setPolicy (DeliveryPolicy policy);
+  DeliveryPolicy policy () const;
+
+      /** Producer: get a free slot, waiting up to timeoutMs for one, or
+       * NULL if all slots stay in use */
+  FrameSlot *acquire (int timeoutMs = 0);
+
+      /** Producer: hand a filled slot to the consumer */
+  void publish (FrameSlot * slot);
+
+      /** Producer: count a frame that was dropped for lack of a slot */
+  void dropFrame ();
+
+      /** Consumer: get the oldest published slot, the newest with
+       * DELIVERY_LATEST, or NULL */
+  FrameSlot *next ();
+
+      /** Consumer: return a slot to the producer */
+  void release (FrameSlot * slot);
+
+      /** Number of slots published and not released yet, wherever they
+       * are in the pipeline. Only exact while the producer is not
+       * running, e.g. once it has finished. */
+  unsigned framesInFlight () const;
+
+      /** Number of frames dropped for lack of a slot so far */
+  unsigned droppedFrames () const;
+
+      /** Number of frames replaced by a newer one before the consumer took
+       * them, DELIVERY_LATEST only */
+  unsigned replacedFrames () const;
+
+      /** Mark all slots as coming from the given camera, 0 by default.
+       * Call before the producer starts. */
+  void setCamera (unsigned camera);
+
+private:
+
+  FrameSlot *m_slots;
+  unsigned m_slotCount;
+
+  DeliveryPolicy m_policy;
+
+  FrameRing m_free;
+  FrameRing m_ready;
+
+      /** Number of slots in m_free, for waiting on one */
+  QSemaphore m_freeCount;
+
+      /** Published slot not taken yet, DELIVERY_LATEST only */
+  QAtomicPointer < FrameSlot > m_mailbox;
+
+      /** Slot taken back from the mailbox, owned by the producer until it
+       * acquires it again */
+  FrameSlot *m_spare;
+
+  unsigned m_nextId;
+  QAtomicInt m_dropped;
+  QAtomicInt m_replaced;
+};
+
+#endif // FRAMEPOOL_HPP_3378120945
@@ -0,0 +1,100 @@
+#include "framereplay.hpp"
+#include "timestamp.hpp"
+
+// How long to wait for a free slot before looking at the stop flag again
+static const int s_slotWaitMs = 50;
+
+ReplayThread::ReplayThread (unsigned slots):FrameSource (slots)
+{
+  m_throttled = true;
+  m_loop = false;
+  m_stop = 0;
+}
+
+ReplayThread::~ReplayThread ()
+{
+}
+
+bool ReplayThread::open (const char *fileName)
+{
+  return m_file.open (fileName);
+}
+
+void ReplayThread::setThrottled (bool throttled)
+{
+  m_throttled = throttled;
+}
+
+void ReplayThread::setLoop (bool loop)
+{
+  m_loop = loop;
+}
+
+void ReplayThread::stop ()
+{
+  m_stop.fetchAndStoreOrdered (1);
+}
+
+void ReplayThread::run ()
+{
+  uint64_t startClock = 0;
+  uint64_t startRecorded = 0;
+
+  m_stop.fetchAndStoreOrdered (0);
+
+  unsigned i = 0;
+  while (!m_stop.fetchAndAddAcquire (0))
+    {
+      if (i == m_file.frameCount ())
+        {
+          if (!m_loop || i == 0)
+            {
+              break;
+            }
+          i = 0;
+          startClock = 0;
+        }
+
+      RecordedFrameView view;
+      m_file.frame (i++, view);
+
+      if (m_throttled)
+        {
+          uint64_t now = monotonicMicroseconds ();
+          if (!startClock)
+            {
+              startClock = now;
+              startRecorded = view.header->timestampUs;
+            }
+          else
+            {
+              uint64_t due = startClock + (view.header->timestampUs - startRecorded);
+              if (due > now)
+                {
+                  usleep (due - now);
+                }
+            }
+        }
+
+      FrameSlot *slot;
+      while ((slot = m_pool.acquire (s_slotWaitMs)) == NULL)
+        {
+          if (m_stop.fetchAndAddAcquire (0))
+            {
+              return;
+            }
+        }
+
+      slot->dd = view.header->dd;
+      slot->data = view.source;
+      slot->dataSize = view.header->sourceSize;
+      slot->amplitudes = view.amplitudes;
+      slot->coordinates = view.coordinates;
+      slot->flags = view.flags;
+      slot->timestampUs = monotonicMicroseconds ();
+
+      m_pool.publish (slot);
+
+      emit hasNewFrame ();
+    }
+}
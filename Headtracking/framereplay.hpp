@@ -0,0 +1,49 @@
+#ifndef FRAMEREPLAY_HPP_4471920036
+#define FRAMEREPLAY_HPP_4471920036
+
+#include "framesource.hpp"
+#include "framefile.hpp"
+
+/** Frame source that plays back a recording instead of the camera.
+ * The recording is memory mapped and its buffers are handed out in place.
+ * Frames carry precomputed amplitudes, coordinates and flags, so no SDK
+ * handle is needed to process them. Replay never drops frames: if all
+ * slots are in use it waits for the consumer.
+ */
+class ReplayThread:public FrameSource
+{
+
+  Q_OBJECT 
+
+public:
+
+      /** Constructor
+       * \param slots Number of frames that can be in flight at once
+       */
+  ReplayThread (unsigned slots = 3);
+  ~ReplayThread ();
+
+      /** Map the recording. Returns false if it is missing or damaged. */
+  bool open (const char *fileName);
+
+      /** If true (default) frames are delivered at the recorded rate,
+       * otherwise as fast as they are consumed. */
+  void setThrottled (bool throttled);
+
+      /** Start over at the end of the recording */
+  void setLoop (bool loop);
+
+  void run ();
+  void stop ();
+
+private:
+
+  FrameFile m_file;
+
+  bool m_throttled;
+  bool m_loop;
+
+  QAtomicInt m_stop;
+};
+
+#endif // FRAMEREPLAY_HPP_4471920036
@@ -0,0 +1,49 @@
+#include "framesource.hpp"
+
+FrameSource::FrameSource (unsigned slots):m_pool (slots)
+{
+}
+
+FrameSource::~FrameSource ()
+{
+}
+
+void FrameSource::stop ()
+{
+  quit ();
+}
+
+FrameSlot *FrameSource::nextFrame ()
+{
+  return m_pool.next ();
+}
+
+void FrameSource::releaseFrame (FrameSlot * slot)
+{
+  m_pool.release (slot);
+}
+
+unsigned FrameSource::framesInFlight () const
+{
+  return m_pool.framesInFlight ();
+}
+
+unsigned FrameSource::droppedFrames () const
+{
+  return m_pool.droppedFrames ();
+}
+
+unsigned FrameSource::replacedFrames () const
+{
+  return m_pool.replacedFrames ();
+}
+
+void FrameSource::setDeliveryPolicy (DeliveryPolicy policy)
+{
+  m_pool.setPolicy (policy);
+}
+
+void FrameSource::setCamera (unsigned camera)
+{
+  m_pool.setCamera (camera);
+}
@@ -0,0 +1,63 @@
+#ifndef FRAMESOURCE_HPP_6129034471
+#define FRAMESOURCE_HPP_6129034471
+
+#include <QThread>
+
+#include "framepool.hpp"
+
+/** Thread that produces frames into a FramePool.
+ * The camera and the replay of a recording are both frame sources, so the
+ * processing side does not need to know where its frames come from.
+ */
+class FrameSource:public QThread
+{
+
+  Q_OBJECT 
+
+public:
+
+      /** Constructor
+       * \param slots Number of frames that can be in flight at once
+       */
+  FrameSource (unsigned slots);
+  virtual ~ FrameSource ();
+
+      /** Ask the thread to finish. Use wait () to join it. */
+  virtual void stop ();
+
+      /** Get the oldest frame or NULL. First consumer thread only. */
+  FrameSlot *nextFrame ();
+
+      /** Return a frame obtained by nextFrame. Last consumer thread only,
+       * which may differ from the one calling nextFrame. */
+  void releaseFrame (FrameSlot * slot);
+
+      /** Number of frames not yet returned with releaseFrame, see
+       * FramePool::framesInFlight */
+  unsigned framesInFlight () const;
+
+      /** Number of frames dropped because all slots were in use */
+  unsigned droppedFrames () const;
+
+      /** Number of frames replaced by newer ones before they were
+       * processed, see DELIVERY_LATEST */
+  unsigned replacedFrames () const;
+
+      /** How frames wait for the processing, DELIVERY_FIFO by default.
+       * Call before the thread is started. */
+  void setDeliveryPolicy (DeliveryPolicy policy);
+
+      /** Number of the camera, written into every frame. Call before the
+       * thread is started. */
+  void setCamera (unsigned camera);
+
+signals:
+
+  void hasNewFrame ();
+
+protected:
+
+  FramePool m_pool;
+};
+
+#endif // FRAMESOURCE_HPP_6129034471
@@ -7,84 +7,117 @@
 #include "./headperspective.hpp"
 
 #include <GL/glu.h>
+#include <algorithm>
+#include <math.h>
+#include <stddef.h>
 
-const static GLfloat cube_normals[6][3] = {
-  {-1.0, 0.0, 0.0},
-  {0.0, 1.0, 0.0},
-  {1.0, 0.0, 0.0},
-  {0.0, -1.0, 0.0},
-  {0.0, 0.0, 1.0},
-  {0.0, 0.0, -1.0}
-};
-const static GLint cube_faces[6][4] = {
-  {0, 1, 2, 3},
-  {3, 2, 6, 7},
-  {7, 6, 5, 4},
-  {4, 5, 1, 0},
-  {5, 6, 2, 1},
-  {7, 4, 0, 3}
-};
-
-HeadPerspective::HeadPerspective (QWidget * parent, HeadTrackFilter * tracker):QGLWidget (parent)
+#include "latencystats.hpp"
+#include "timestamp.hpp"
+
+// Extrapolate at most this far, so a lost head does not fly off
+static const uint64_t s_maxPredictionUs = 100000;
+
+// Paints closer together than this mean the swap does not wait for the
+// retrace, so the render timer has to pace itself
+static const float s_minRefreshIntervalUs = 5000.0f;
+
+// Number of segments of a ring of a target
+static const int s_ringSegments = 36;
+
+static QGLFormat vsyncFormat ()
+{
+  QGLFormat format;
+  format.setSwapInterval (1);
+  return format;
+}
+
+HeadPerspective::HeadPerspective (QWidget * parent):QGLWidget (vsyncFormat (), parent)
 {
-  m_tracker = tracker;
+  m_hasPose = false;
+  m_prediction = false;
+  m_lastPaintUs = 0;
+  m_refreshIntervalUs = 16667.0f;
+
+  m_renderTimer = new QTimer (this);
+  m_renderTimer->setInterval (0);
+  connect (m_renderTimer, SIGNAL (timeout ()), this, SLOT (updateGL ()));
 
   m_headPosition[0] = 0.0f;
   m_headPosition[1] = 0.0f;
-  m_headPosition[2] = 2.0f;
+  m_headPosition[2] = 2000.0f;
 
   m_monitorWidth = 475;
 
-  m_firstCoords = true;
   m_anaglyph = false;
 
-  m_kalman = cvCreateKalman (6, 3, 0);
-
-  m_measurement = cvCreateMat (3, 1, CV_32FC1);
-
-  const float F[] = {
-    1, 0, 0, 1, 0, 0,           // x + dx
-    0, 1, 0, 0, 1, 0,           // y + dy
-    0, 0, 1, 0, 0, 1,           // z + dz
-    0, 0, 0, 1, 0, 0,           // dx = dx
-    0, 0, 0, 0, 1, 0,           // dy = dy
-    0, 0, 0, 0, 0, 1,           // dz = dz
-  };
-  memcpy (m_kalman->transition_matrix->data.fl, F, sizeof (F));
+  m_scene = 0;
+  m_builtHeight = -1;
+  m_sceneLists = 0;
+  for (int i = 0; i < SCENE_COUNT; ++i)
+    {
+      m_sceneVertices[i] = 0;
+    }
 
-  cvZero (m_measurement);
+  setPrediction (true);
 }
 
 HeadPerspective::~HeadPerspective ()
 {
-  cvReleaseKalman (&m_kalman);
-  cvReleaseMat (&m_measurement);
+  makeCurrent ();
+
+  if (m_sceneLists)
+    {
+      glDeleteLists (m_sceneLists, SCENE_COUNT);
+    }
+  for (int i = 0; i < SCENE_COUNT; ++i)
+    {
+      m_sceneBuffers[i].destroy ();
+    }
 }
 
-void HeadPerspective::setHeadCoords (float *headPosition)
+void HeadPerspective::setHeadPose (const HeadPose & pose)
 {
-  if (m_firstCoords)
+  m_pose = pose;
+  m_hasPose = true;
+
+  if (!m_prediction)
     {
-      resetHead ();
-      m_firstCoords = false;
+      predictHeadPosition (pose.timestampUs);
+      updateGL ();
     }
+}
 
-  // Update Kalman filter
-  m_measurement->data.fl[0] = headPosition[0] * 1000.0f;        // x point
-  m_measurement->data.fl[1] = headPosition[1] * 1000.0f;        // y point
-  m_measurement->data.fl[2] = headPosition[2] * 1000.0f;        // z point
-
-  const CvMat *prediction = cvKalmanPredict (m_kalman, 0);
+void HeadPerspective::setPrediction (bool enabled)
+{
+  m_prediction = enabled;
 
-  // adjust Kalman filter state
-  cvKalmanCorrect (m_kalman, m_measurement);
+  if (enabled)
+    {
+      m_lastPaintUs = 0;
+      m_renderTimer->setInterval (0);
+      m_renderTimer->start ();
+    }
+  else
+    {
+      m_renderTimer->stop ();
+    }
+}
 
-  m_headPosition[0] = prediction->data.fl[0];
-  m_headPosition[1] = prediction->data.fl[1];
-  m_headPosition[2] = prediction->data.fl[2];
+void HeadPerspective::predictHeadPosition (uint64_t timeUs)
+{
+  if (!m_hasPose)
+    {
+      return;
+    }
 
-  updateGL ();
+  uint64_t ahead = (timeUs > m_pose.timestampUs) ? timeUs - m_pose.timestampUs : 0;
+  float dt = std::min (ahead, s_maxPredictionUs) / 1e6f;
 
+  // The scene is modelled in millimeters
+  for (int i = 0; i < 3; ++i)
+    {
+      m_headPosition[i] = (m_pose.filtered[i] + m_pose.velocity[i] * dt) * 1000.0f;
+    }
 }
 
 void HeadPerspective::initializeGL ()
@@ -127,6 +160,27 @@ void HeadPerspective::setUserPerspective ()
 
 void HeadPerspective::paintGL ()
 {
+  StageTimer timer (STAGE_PAINT);
+
+  if (m_prediction)
+    {
+      uint64_t now = monotonicMicroseconds ();
+      if (m_lastPaintUs)
+        {
+          m_refreshIntervalUs = 0.9f * m_refreshIntervalUs + 0.1f * (now - m_lastPaintUs);
+        }
+      m_lastPaintUs = now;
+
+      // Without a retrace to wait for, pace the timer to about 60 Hz
+      if (m_refreshIntervalUs < s_minRefreshIntervalUs)
+        {
+          m_renderTimer->setInterval (16);
+        }
+
+      // This frame is shown after the next retrace
+      predictHeadPosition (now + (uint64_t) m_refreshIntervalUs);
+    }
+
   glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
   // Set the user-centered perspective
@@ -142,7 +196,7 @@ void HeadPerspective::paintGL ()
       glPushMatrix ();
       gluLookAt (-0.025, 0.0, 2.0, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0);
 
-      drawTargets ();
+      drawScene ();
 
       glPopMatrix ();
 
@@ -154,14 +208,14 @@ void HeadPerspective::paintGL ()
       glPushMatrix ();
       gluLookAt (0.025, 0.0, 2.0, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0);
 
-      drawTargets ();
+      drawScene ();
 
       glPopMatrix ();
       glColorMask (GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
     }
   else
     {
-      drawTargets ();
+      drawScene ();
     }
 }
 
@@ -182,183 +236,231 @@ void HeadPerspective::resizeGL (int width, int height)
   glEnable (GL_DEPTH_TEST);
 }
 
-void HeadPerspective::drawTargets ()
+static inline void addVertex (HeadPerspective::Geometry & geometry,
+                              float x, float y, float z, const GLfloat * color)
 {
-  glDisable (GL_TEXTURE_2D);
-
-  // Ceiling
-  glPushMatrix ();
-  glBegin (GL_QUADS);
-  glColor3f (0.3f, 0.3f, 0.3f);
-  glVertex3i (-m_monitorWidth / 2, m_monitorHeight / 2, 0);
-  glVertex3i (m_monitorWidth / 2, m_monitorHeight / 2, 0);
-  glVertex3i (m_monitorWidth / 2, m_monitorHeight / 2, -m_monitorWidth);
-  glVertex3i (-m_monitorWidth / 2, m_monitorHeight / 2, -m_monitorWidth);
-  glEnd ();
-  glPopMatrix ();
-
-  // Floor
-  glPushMatrix ();
-  glBegin (GL_QUADS);
-  glColor3f (0.3f, 0.3f, 0.3f);
-  glVertex3i (-m_monitorWidth / 2, -m_monitorHeight / 2, 0);
-  glVertex3i (m_monitorWidth / 2, -m_monitorHeight / 2, 0);
-  glVertex3i (m_monitorWidth / 2, -m_monitorHeight / 2, -m_monitorWidth);
-  glVertex3i (-m_monitorWidth / 2, -m_monitorHeight / 2, -m_monitorWidth);
-  glEnd ();
-  glPopMatrix ();
-
-  // Left
-  glPushMatrix ();
-  glBegin (GL_QUADS);
-  glColor3f (0.4f, 0.4f, 0.4f);
-  glVertex3i (-m_monitorWidth / 2, m_monitorHeight / 2, 0);
-  glVertex3i (-m_monitorWidth / 2, -m_monitorHeight / 2, 0);
-  glVertex3i (-m_monitorWidth / 2, -m_monitorHeight / 2, -m_monitorWidth);
-  glVertex3i (-m_monitorWidth / 2, m_monitorHeight / 2, -m_monitorWidth);
-  glEnd ();
-  glPopMatrix ();
-
-  // Right
-  glPushMatrix ();
-  glBegin (GL_QUADS);
-  glColor3f (0.4f, 0.4f, 0.4f);
-  glVertex3i (m_monitorWidth / 2, m_monitorHeight / 2, 0);
-  glVertex3i (m_monitorWidth / 2, -m_monitorHeight / 2, 0);
-  glVertex3i (m_monitorWidth / 2, -m_monitorHeight / 2, -m_monitorWidth);
-  glVertex3i (m_monitorWidth / 2, m_monitorHeight / 2, -m_monitorWidth);
-  glEnd ();
-  glPopMatrix ();
-
-  // Back
-  glPushMatrix ();
-  glBegin (GL_QUADS);
-  glColor3f (0.2f, 0.2f, 0.2f);
-  glVertex3i (-m_monitorWidth / 2, m_monitorHeight / 2, -m_monitorWidth);
-  glVertex3i (m_monitorWidth / 2, m_monitorHeight / 2, -m_monitorWidth);
-  glVertex3i (m_monitorWidth / 2, -m_monitorHeight / 2, -m_monitorWidth);
-  glVertex3i (-m_monitorWidth / 2, -m_monitorHeight / 2, -m_monitorWidth);
-  glEnd ();
-  glPopMatrix ();
-
-  float target_offset = 80;
-  float target_radius = 20;
-  float depth_increment = m_monitorWidth / 3;
-
-  // Center
-  glPushMatrix ();
-  glTranslated (0.0, 0.0, 0.0);
-  drawTarget (target_radius, 0.0f, 0.0f, 0.0f);
-  glPopMatrix ();
-
-  // Left
-  glPushMatrix ();
-  glTranslated (-target_offset, 0, depth_increment);
-  drawTarget (target_radius, 0.0f, 0.0f, 0.0f);
-  glPopMatrix ();
-
-  // Top
-  glPushMatrix ();
-  glTranslated (0, target_offset, -depth_increment);
-  drawTarget (target_radius, 0.0f, 0.0f, 0.0f);
-  glPopMatrix ();
-
-  // Right
-  glPushMatrix ();
-  glTranslated (target_offset, 0, -2 * depth_increment);
-  drawTarget (target_radius, 0.0f, 0.0f, 0.0f);
-  glPopMatrix ();
-
-  // Down
-  glPushMatrix ();
-  glTranslated (0, -target_offset, 2 * depth_increment);
-  drawTarget (target_radius, 0.0f, 0.0f, 0.0f);
-  glPopMatrix ();
+  HeadPerspective::SceneVertex v;
+  v.position[0] = x;
+  v.position[1] = y;
+  v.position[2] = z;
+  v.color[0] = color[0];
+  v.color[1] = color[1];
+  v.color[2] = color[2];
+  geometry.push_back (v);
 }
 
-void HeadPerspective::drawTarget (float radius, float r, float g, float b)
+// Two triangles for the quad a b c d
+static void addQuad (HeadPerspective::Geometry & geometry,
+                     const GLfloat * a, const GLfloat * b, const GLfloat * c, const GLfloat * d, const GLfloat * color)
 {
-  glPushMatrix ();
-  glColor3f (1.0f, 1.0f, 1.0f);
-  float length = 10000.0f;
-  glTranslated (0, 0, -(length / 2 + 15));
-  glScaled (radius / 10.0f, radius / 10.0f, length);
-  drawCube (1, GL_QUADS);
-  glPopMatrix ();
-
-  glPushMatrix ();
-  float radius_increment = radius / 4;
-
-  {
-    glColor3f (r, g, b);
-    glPushMatrix ();
-    GLUquadric *quadric = gluNewQuadric ();
-    gluDisk (quadric, 0, radius_increment, 36, 36);
-    gluDeleteQuadric (quadric);
-    glPopMatrix ();
-  }
-
-  {
-    glColor3f (1.0f, 1.0f, 1.0f);
-    glPushMatrix ();
-    GLUquadric *quadric = gluNewQuadric ();
-    gluDisk (quadric, radius_increment, 2.0 * radius_increment, 36, 36);
-    gluDeleteQuadric (quadric);
-    glPopMatrix ();
-  }
-
-  {
-    glColor3f (r, g, b);
-    glPushMatrix ();
-    GLUquadric *quadric = gluNewQuadric ();
-    gluDisk (quadric, 2.0 * radius_increment, 3.0 * radius_increment, 36, 36);
-    gluDeleteQuadric (quadric);
-    glPopMatrix ();
-  }
-
-  {
-    glColor3f (1.0f, 1.0f, 1.0f);
-    glPushMatrix ();
-    GLUquadric *quadric = gluNewQuadric ();
-    gluDisk (quadric, 3.0 * radius_increment, 4.0 * radius_increment, 36, 36);
-    gluDeleteQuadric (quadric);
-    glPopMatrix ();
-  }
-
-  glPopMatrix ();
+  addVertex (geometry, a[0], a[1], a[2], color);
+  addVertex (geometry, b[0], b[1], b[2], color);
+  addVertex (geometry, c[0], c[1], c[2], color);
+  addVertex (geometry, a[0], a[1], a[2], color);
+  addVertex (geometry, c[0], c[1], c[2], color);
+  addVertex (geometry, d[0], d[1], d[2], color);
 }
 
-void HeadPerspective::drawCube (GLfloat size, GLenum type)
+// Box with the given center and size
+static void addBox (HeadPerspective::Geometry & geometry,
+                    const GLfloat * center, const GLfloat * size, const GLfloat * color)
 {
   GLfloat v[8][3];
-  GLint i;
+  for (int i = 0; i < 8; ++i)
+    {
+      v[i][0] = center[0] + ((i & 4) ? 0.5f : -0.5f) * size[0];
+      v[i][1] = center[1] + ((i & 2) ? 0.5f : -0.5f) * size[1];
+      v[i][2] = center[2] + ((i & 1) ? 0.5f : -0.5f) * size[2];
+    }
 
-  v[0][0] = v[1][0] = v[2][0] = v[3][0] = -size / 2;
-  v[4][0] = v[5][0] = v[6][0] = v[7][0] = size / 2;
-  v[0][1] = v[1][1] = v[4][1] = v[5][1] = -size / 2;
-  v[2][1] = v[3][1] = v[6][1] = v[7][1] = size / 2;
-  v[0][2] = v[3][2] = v[4][2] = v[7][2] = -size / 2;
-  v[1][2] = v[2][2] = v[5][2] = v[6][2] = size / 2;
+  static const int faces[6][4] = {
+    {0, 1, 3, 2}, {4, 6, 7, 5}, {0, 4, 5, 1}, {2, 3, 7, 6}, {0, 2, 6, 4}, {1, 5, 7, 3}
+  };
 
-  for (i = 5; i >= 0; i--)
+  for (int f = 0; f < 6; ++f)
     {
-      glBegin (type);
-      glNormal3fv (&cube_normals[i][0]);
-      glVertex3fv (&v[cube_faces[i][0]][0]);
-      glVertex3fv (&v[cube_faces[i][1]][0]);
-      glVertex3fv (&v[cube_faces[i][2]][0]);
-      glVertex3fv (&v[cube_faces[i][3]][0]);
-      glEnd ();
+      addQuad (geometry, v[faces[f][0]], v[faces[f][1]], v[faces[f][2]], v[faces[f][3]], color);
     }
 }
 
-void HeadPerspective::resetHead ()
+void HeadPerspective::addRoom (Geometry & geometry)
 {
-  // Initialize Kalman filter
-  cvSetIdentity (m_kalman->measurement_matrix, cvRealScalar (1));
-  cvSetIdentity (m_kalman->process_noise_cov, cvRealScalar (1e-3));
-  cvSetIdentity (m_kalman->measurement_noise_cov, cvRealScalar (2e+2));
-  cvSetIdentity (m_kalman->error_cov_post, cvRealScalar (1));
+  GLfloat w = m_monitorWidth / 2, h = m_monitorHeight / 2, d = -m_monitorWidth;
+
+  const GLfloat topFront[2][3] = { {-w, h, 0}, {w, h, 0} };
+  const GLfloat topBack[2][3] = { {-w, h, d}, {w, h, d} };
+  const GLfloat bottomFront[2][3] = { {-w, -h, 0}, {w, -h, 0} };
+  const GLfloat bottomBack[2][3] = { {-w, -h, d}, {w, -h, d} };
+
+  const GLfloat ceiling[3] = { 0.3f, 0.3f, 0.3f };
+  const GLfloat wall[3] = { 0.4f, 0.4f, 0.4f };
+  const GLfloat back[3] = { 0.2f, 0.2f, 0.2f };
+
+  addQuad (geometry, topFront[0], topFront[1], topBack[1], topBack[0], ceiling);
+  addQuad (geometry, bottomFront[0], bottomFront[1], bottomBack[1], bottomBack[0], ceiling);
+  addQuad (geometry, topFront[0], bottomFront[0], bottomBack[0], topBack[0], wall);
+  addQuad (geometry, topFront[1], bottomFront[1], bottomBack[1], topBack[1], wall);
+  addQuad (geometry, topBack[0], topBack[1], bottomBack[1], bottomBack[0], back);
+}
+
+void HeadPerspective::addTarget (Geometry & geometry, float x, float y, float z, float radius)
+{
+  const GLfloat white[3] = { 1.0f, 1.0f, 1.0f };
+  const GLfloat black[3] = { 0.0f, 0.0f, 0.0f };
+
+  // Stick reaching back from the target
+  float length = 10000.0f;
+  const GLfloat center[3] = { x, y, z - (length / 2 + 15) };
+  const GLfloat size[3] = { radius / 10.0f, radius / 10.0f, length };
+  addBox (geometry, center, size, white);
+
+  // Four rings, alternating black and white from the inside
+  float ringWidth = radius / 4;
+
+  for (int ring = 0; ring < 4; ++ring)
+    {
+      const GLfloat *color = (ring & 1) ? white : black;
+      float r0 = ring * ringWidth, r1 = (ring + 1) * ringWidth;
+
+      for (int s = 0; s < s_ringSegments; ++s)
+        {
+          float a0 = 2.0f * M_PI * s / s_ringSegments;
+          float a1 = 2.0f * M_PI * (s + 1) / s_ringSegments;
+
+          const GLfloat q[4][3] = {
+            {x + r0 * cosf (a0), y + r0 * sinf (a0), z},
+            {x + r1 * cosf (a0), y + r1 * sinf (a0), z},
+            {x + r1 * cosf (a1), y + r1 * sinf (a1), z},
+            {x + r0 * cosf (a1), y + r0 * sinf (a1), z}
+          };
+          addQuad (geometry, q[0], q[1], q[2], q[3], color);
+        }
+    }
+}
+
+void HeadPerspective::buildScene (int scene, Geometry & geometry)
+{
+  float offset = 80;
+  float radius = 20;
+  float depth = m_monitorWidth / 3;
+
+  switch (scene)
+    {
+      case 1:
+        // Grid of targets receding into the room
+        addRoom (geometry);
+        for (int i = 0; i < 9; ++i)
+          {
+            addTarget (geometry, (i % 3 - 1) * 1.5f * offset, (i / 3 - 1) * offset, (1 - i % 4) * depth, radius);
+          }
+        break;
+
+      case 2:
+        // Spiral of targets in front of and behind the screen, no room
+        for (int i = 0; i < 12; ++i)
+          {
+            float a = i * M_PI / 3.0f;
+            addTarget (geometry, 1.5f * offset * cosf (a), offset * sinf (a), (2 - i * 0.4f) * depth, radius);
+          }
+        break;
+
+      case 0:
+      default:
+        // The room with five targets
+        addRoom (geometry);
+        addTarget (geometry, 0.0f, 0.0f, 0.0f, radius);
+        addTarget (geometry, -offset, 0.0f, depth, radius);
+        addTarget (geometry, 0.0f, offset, -depth, radius);
+        addTarget (geometry, offset, 0.0f, -2 * depth, radius);
+        addTarget (geometry, 0.0f, -offset, 2 * depth, radius);
+        break;
+    }
+}
+
+void HeadPerspective::buildScenes ()
+{
+  if (!m_sceneLists && !m_sceneBuffers[0].isCreated ())
+    {
+      for (int i = 0; i < SCENE_COUNT; ++i)
+        {
+          m_sceneBuffers[i] = QGLBuffer (QGLBuffer::VertexBuffer);
+          m_sceneBuffers[i].setUsagePattern (QGLBuffer::StaticDraw);
+          if (!m_sceneBuffers[i].create ())
+            {
+              // No vertex buffers, e.g. on old software GL
+              m_sceneLists = glGenLists (SCENE_COUNT);
+              break;
+            }
+        }
+    }
+
+  Geometry geometry;
+
+  for (int i = 0; i < SCENE_COUNT; ++i)
+    {
+      geometry.clear ();
+      buildScene (i, geometry);
+      m_sceneVertices[i] = geometry.size ();
+
+      if (m_sceneLists)
+        {
+          glNewList (m_sceneLists + i, GL_COMPILE);
+          glEnableClientState (GL_VERTEX_ARRAY);
+          glEnableClientState (GL_COLOR_ARRAY);
+          glVertexPointer (3, GL_FLOAT, sizeof (SceneVertex), geometry[0].position);
+          glColorPointer (3, GL_FLOAT, sizeof (SceneVertex), geometry[0].color);
+          glDrawArrays (GL_TRIANGLES, 0, geometry.size ());
+          glDisableClientState (GL_COLOR_ARRAY);
+          glDisableClientState (GL_VERTEX_ARRAY);
+          glEndList ();
+        }
+      else
+        {
+          m_sceneBuffers[i].bind ();
+          m_sceneBuffers[i].allocate (&geometry[0], geometry.size () * sizeof (SceneVertex));
+          m_sceneBuffers[i].release ();
+        }
+    }
+
+  m_builtHeight = m_monitorHeight;
+}
+
+void HeadPerspective::drawScene ()
+{
+  if (m_monitorHeight != m_builtHeight)
+    {
+      buildScenes ();
+    }
+
+  if (m_sceneLists)
+    {
+      glCallList (m_sceneLists + m_scene);
+      return;
+    }
+
+  m_sceneBuffers[m_scene].bind ();
+
+  glEnableClientState (GL_VERTEX_ARRAY);
+  glEnableClientState (GL_COLOR_ARRAY);
+  glVertexPointer (3, GL_FLOAT, sizeof (SceneVertex), (const GLvoid *) offsetof (SceneVertex, position));
+  glColorPointer (3, GL_FLOAT, sizeof (SceneVertex), (const GLvoid *) offsetof (SceneVertex, color));
+
+  glDrawArrays (GL_TRIANGLES, 0, m_sceneVertices[m_scene]);
+
+  glDisableClientState (GL_COLOR_ARRAY);
+  glDisableClientState (GL_VERTEX_ARRAY);
+
+  m_sceneBuffers[m_scene].release ();
+}
+
+void HeadPerspective::setScene (int scene)
+{
+  m_scene = (scene >= 0 && scene < SCENE_COUNT) ? scene : 0;
+
+  if (!m_prediction)
+    {
+      updateGL ();
+    }
 }
 
 void HeadPerspective::toggleAnaglyph ()
@@ -368,13 +470,17 @@ void HeadPerspective::toggleAnaglyph ()
 
 void HeadPerspective::keyPressEvent (QKeyEvent * kEvent)
 {
-  if (kEvent->key () == Qt::Key_R)
+  // R resets the tracking of all cameras, see MainWindow::resetTracking
+  if (kEvent->key () == Qt::Key_A)
     {
-      resetHead ();
-      m_tracker->resetHead ();
+      toggleAnaglyph ();
     }
-  else if (kEvent->key () == Qt::Key_A)
+  else if (kEvent->key () == Qt::Key_P)
     {
-      toggleAnaglyph ();
+      setPrediction (!m_prediction);
+    }
+  else if (kEvent->key () == Qt::Key_S)
+    {
+      setScene ((m_scene + 1) % SCENE_COUNT);
     }
 }
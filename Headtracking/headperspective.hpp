@@ -12,12 +12,10 @@
 #include <QtGui>
 
 #include <QTimer>
+#include <QGLBuffer>
+#include <vector>
 
-#include <opencv/highgui.h>
-#include <opencv/cxcore.h>
-#include <opencv/cv.h>
-
-#include "headtrackfilter.hpp"
+#include "headtracker.hpp"
 
 class HeadPerspective:public QGLWidget
 {
@@ -25,7 +23,7 @@ class HeadPerspective:public QGLWidget
 
 public:
 
-  HeadPerspective (QWidget * parent = 0, HeadTrackFilter * app = 0);
+  HeadPerspective (QWidget * parent = 0);
   virtual ~ HeadPerspective ();
 
 protected:
@@ -36,19 +34,47 @@ protected:
 
 public:
 
-  void setHeadCoords (float *headPosition);
+      /** Set the head pose. Redraws right away without prediction. */
+  void setHeadPose (const HeadPose & pose);
+
+      /** Redraw at the display refresh rate and extrapolate the head pose
+       * to the time each frame is shown, instead of redrawing when a pose
+       * arrives. On by default. */
+  void setPrediction (bool enabled);
 
-  void resetHead ();
   void toggleAnaglyph ();
+
+      /** Select one of the precomputed scenes, see SCENE_COUNT */
   void setScene (int scene);
 
+      /** Number of scenes to choose from */
+  static const int SCENE_COUNT = 3;
+
+      /** One vertex of the scene geometry */
+  struct SceneVertex
+  {
+    GLfloat position[3];
+    GLfloat color[3];
+  };
+
+  typedef std::vector < SceneVertex > Geometry;
+
 protected:
 
   void setUserPerspective ();
 
-  void drawTargets ();
-  void drawTarget (float radius, float r, float g, float b);
-  void drawCube (GLfloat size, GLenum type);
+      /** Head position in millimeters for a frame shown at timeUs */
+  void predictHeadPosition (uint64_t timeUs);
+
+      /** Triangles of the scenes, in millimeters */
+  void buildScene (int scene, Geometry & geometry);
+  void addRoom (Geometry & geometry);
+  void addTarget (Geometry & geometry, float x, float y, float z, float radius);
+
+      /** Upload all scenes for the current monitor size */
+  void buildScenes ();
+
+  void drawScene ();
 
   void keyPressEvent (QKeyEvent * kEvent);
 
@@ -56,21 +82,37 @@ private:
 
   GLfloat m_headPosition[3];
 
+      /** Last pose from the tracker, valid if m_hasPose */
+  HeadPose m_pose;
+  bool m_hasPose;
+
+  bool m_prediction;
+
+      /** Redraws continuously; swapping waits for the vertical retrace */
+  QTimer *m_renderTimer;
+
+      /** Time of the last paint and the smoothed time between two paints */
+  uint64_t m_lastPaintUs;
+  float m_refreshIntervalUs;
+
   int m_width;
   int m_height;
 
   int m_monitorWidth;
   int m_monitorHeight;
 
-  bool m_firstCoords;
-
   bool m_anaglyph;
 
-  CvKalman *m_kalman;
+  int m_scene;
 
-  CvMat *m_measurement;
+      /** Monitor height the scenes were built for */
+  int m_builtHeight;
 
-  HeadTrackFilter *m_tracker;
+      /** Per scene vertex buffer, or display list if there are no vertex
+       * buffers, and number of vertices */
+  QGLBuffer m_sceneBuffers[SCENE_COUNT];
+  GLuint m_sceneLists;
+  int m_sceneVertices[SCENE_COUNT];
 };
 
 #endif // _HEADPERSPECTIVE_HPP_463738376754
@@ -12,7 +12,9 @@
 #include <pmdsdk2.h>
 
 #include "headperspective.hpp"
-#include "headtrackfilter.hpp"
+#include "headtracker.hpp"
+#include "framepool.hpp"
+#include "preview.hpp"
 
 using namespace cv;
 
@@ -37,59 +39,34 @@ public:
       /** from LightVisApp */
   QWidget *makeWidget (QWidget * parent);
 
-  void newSourceData (PMDDataDescription * dd, void *data);
-  void newAmplitudes (float *);
-  void new3DCoordinates (float *);
-  void newFlags (unsigned *);
-  void finishedFrame ();
+      /** Tracker to run on the frames. Runs in the tracking thread, so
+       * only call its thread safe members from here. */
+  HeadTracker *tracker ();
 
-private:
-
-  void getCoords (int faceX, int faceY);
-
-private:
+      /** Show the pose of a tracked frame */
+  void showFrame (const FrameSlot & slot);
 
-      /** Number of rows in the current image */
-  unsigned m_rows;
-
-      /** Number of columns in the current image */
-  unsigned m_columns;
-
-      /** Origin of the image */
-  unsigned m_pixelOrigin;
+      /** Show the tracking image of a frame with the face marked, see
+       * PreviewWidget. The widget paints straight from the gray buffer of
+       * the frame with the next event loop run, so it holds the frame
+       * until the next one replaces it.
+       * \param slot Frame with a tracking image, NULL to show none
+       * \return The frame shown before, to be released, or NULL
+       */
+  FrameSlot *showPreview (FrameSlot * slot);
 
-      /** Number of pixels currently allocated in m_pixels */
-  unsigned m_reservedPixels;
+      /** Show or hide the tracking image */
+  void setPreviewVisible (bool visible);
 
-      /** Qt image for the display widget */
-  QImage m_image;
+private:
 
-      /** Label to display the image in */
-  QLabel *m_imageLabel;
+      /** Widget to display the image in */
+  PreviewWidget *m_preview;
 
   QLabel *m_coordLabel;
 
-      /** Amplitudes array */
-  float *m_amplitudes;
-
-      /** Coordinates array */
-  float *m_coords;
-
-      /** Flags array */
-  unsigned *m_flags;
-
-      /** Crop pixels from all four sides */
-  unsigned m_cropBy;
-
-      /** Number of instantiations of the class. Not a reference counter. */
-  static unsigned s_instances;
-
-  IplImage *m_gray;
-
-  float m_headPosition[3];
-
   HeadPerspective *m_perspecView;
-  HeadTrackFilter *m_tracker;
+  HeadTracker *m_tracker;
 };
 
 #endif // HEADTRACK_HPP_9087598984
@@ -7,7 +7,9 @@ DEPENDPATH += .
 
 QT += opengl 
 
+include(core/core.pri)
+
 # Input
-HEADERS += mainwindow.hpp headtracking.hpp headperspective.hpp headtrackfilter.hpp
-SOURCES += main.cpp mainwindow.cpp headtracking.cpp headperspective.cpp headtrackfilter.cpp
+HEADERS += mainwindow.hpp headtracking.hpp headperspective.hpp framepool.hpp framesource.hpp framereplay.hpp framefile.hpp pipeline.hpp preview.hpp
+SOURCES += main.cpp mainwindow.cpp headtracking.cpp headperspective.cpp framepool.cpp framesource.cpp framereplay.cpp framefile.cpp pipeline.cpp preview.cpp
 TARGET   = headtracking
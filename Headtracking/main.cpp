@@ -5,7 +5,7 @@ int main (int argc, char *argv[])
 {
   QApplication app (argc, argv);
 
-  MainWindow mw;
+  MainWindow mw (app.arguments ());
 
   mw.show ();
 
@@ -1,17 +1,18 @@
 #include "mainwindow.hpp"
+#include "framereplay.hpp"
+#include "timestamp.hpp"
+#include "latencystats.hpp"
 
-MainWindow::MainWindow ()
-{
-  m_pFlags = 0;
-  m_pAmplitudes = 0;
-  m_pCoordinates = 0;
-  m_dataSize = 0;
-
-  m_thread = 0;
-  m_fpsCounter = 0;
+// Longest wait for a free slot before a frame is read and dropped, see
+// DELIVERY_FIFO
+static const int s_slotWaitMs = 100;
 
-  m_hnd = 0;
+// How often to look whether the last replayed frames are through the
+// pipeline
+static const int s_drainPollMs = 10;
 
+MainWindow::MainWindow (const QStringList & arguments)
+{
   m_pApp = new HeadTracking (this);
 
   QWidget *mainWidget = m_pApp->makeWidget (this);
@@ -20,84 +21,573 @@ MainWindow::MainWindow ()
 
   setCentralWidget (mainWidget);
 
-  m_thread = new AquisitionThread ();
-  QObject::connect (m_thread, SIGNAL (hasNewFrame (PMDDataDescription *, void *)), this,
-                    SLOT (newFrame (PMDDataDescription *, void *)));
+  m_statsLabel = new QLabel (mainWidget);
+  m_statsLabel->setAttribute (Qt::WA_TransparentForMouseEvents);
+  m_statsLabel->setStyleSheet ("QLabel { background-color: rgba(0, 0, 0, 160); color: white; "
+                               "font-family: monospace; padding: 4px; }");
+  m_statsLabel->move (8, 8);
+  m_statsLabel->hide ();
+
+  QAction *overlayAction = new QAction ("Latency overlay", this);
+  overlayAction->setShortcut (QKeySequence ("Ctrl+L"));
+  connect (overlayAction, SIGNAL (triggered ()), this, SLOT (toggleOverlay ()));
+  addAction (overlayAction);
+
+  QAction *previewAction = new QAction ("Tracking image preview", this);
+  previewAction->setShortcut (QKeySequence ("Ctrl+I"));
+  connect (previewAction, SIGNAL (triggered ()), this, SLOT (togglePreview ()));
+  addAction (previewAction);
+
+  QAction *resetAction = new QAction ("Reset tracking", this);
+  resetAction->setShortcut (QKeySequence ("R"));
+  connect (resetAction, SIGNAL (triggered ()), this, SLOT (resetTracking ()));
+  addAction (resetAction);
+
+  m_statsTimer = new QTimer (this);
+  connect (m_statsTimer, SIGNAL (timeout ()), this, SLOT (updateStatistics ()));
+  m_statsTimer->start (500);
+
+  QStringList replayFiles;
+  QString extrinsicsFile;
+  unsigned cameraCount = 1;
+  bool autoExposure = true;
+  float fpsTarget = 60.0f;
+  m_integrationUs = 500;
+  QString delivery;
+  QString recordFile;
+  bool throttled = true;
+  bool loop = false;
+  unsigned queueDepth = 2;
+  CalcMode calcMode = CALC_SEQUENTIAL;
+  HeadTrackFilter::DetectionMode detectionMode = HeadTrackFilter::DETECT_DEPTH;
+  HeadTracker::MotionModel motionModel = HeadTracker::MOTION_CONSTANT_VELOCITY;
+  unsigned maxHeads = 1;
+  bool temporalFilter = false;
+  QString publishName;
+  QString publishUnix;
+  int publishPort = 0;
+  m_previewRate = 10;
+
+  for (int i = 1; i < arguments.size (); ++i)
+    {
+      if (arguments[i] == "--replay" && i + 1 < arguments.size ())
+        {
+          replayFiles.append (arguments[++i]);
+        }
+      else if (arguments[i] == "--cameras" && i + 1 < arguments.size ())
+        {
+          cameraCount = qMax (arguments[++i].toInt (), 1);
+        }
+      else if (arguments[i] == "--extrinsics" && i + 1 < arguments.size ())
+        {
+          extrinsicsFile = arguments[++i];
+        }
+      else if (arguments[i] == "--exposure" && i + 1 < arguments.size ())
+        {
+          QString mode = arguments[++i];
+          autoExposure = mode == "auto";
+          if (!autoExposure)
+            {
+              m_integrationUs = qMax (mode.toInt (), 1);
+            }
+        }
+      else if (arguments[i] == "--delivery" && i + 1 < arguments.size ())
+        {
+          delivery = arguments[++i];
+        }
+      else if (arguments[i] == "--fps-target" && i + 1 < arguments.size ())
+        {
+          fpsTarget = qMax (arguments[++i].toFloat (), 0.0f);
+        }
+      else if (arguments[i] == "--record" && i + 1 < arguments.size ())
+        {
+          recordFile = arguments[++i];
+        }
+      else if (arguments[i] == "--unthrottled")
+        {
+          throttled = false;
+        }
+      else if (arguments[i] == "--loop")
+        {
+          loop = true;
+        }
+      else if (arguments[i] == "--queue-depth" && i + 1 < arguments.size ())
+        {
+          queueDepth = qMax (arguments[++i].toInt (), 1);
+        }
+      else if (arguments[i] == "--calc" && i + 1 < arguments.size ())
+        {
+          QString mode = arguments[++i];
+          if (mode == "concurrent")
+            {
+              calcMode = CALC_CONCURRENT;
+            }
+          else if (mode == "lazy")
+            {
+              calcMode = CALC_LAZY;
+            }
+          else
+            {
+              calcMode = CALC_SEQUENTIAL;
+            }
+        }
+      else if (arguments[i] == "--detect" && i + 1 < arguments.size ())
+        {
+          QString mode = arguments[++i];
+          if (mode == "haar")
+            {
+              detectionMode = HeadTrackFilter::DETECT_HAAR;
+            }
+          else if (mode == "guided")
+            {
+              detectionMode = HeadTrackFilter::DETECT_HAAR_GUIDED;
+            }
+          else
+            {
+              detectionMode = HeadTrackFilter::DETECT_DEPTH;
+            }
+        }
+      else if (arguments[i] == "--motion" && i + 1 < arguments.size ())
+        {
+          motionModel = (arguments[++i] == "acceleration") ? HeadTracker::MOTION_CONSTANT_ACCELERATION :
+            HeadTracker::MOTION_CONSTANT_VELOCITY;
+        }
+      else if (arguments[i] == "--preview-rate" && i + 1 < arguments.size ())
+        {
+          m_previewRate = qMax (arguments[++i].toInt (), 0);
+        }
+      else if (arguments[i] == "--max-heads" && i + 1 < arguments.size ())
+        {
+          maxHeads = qMax (arguments[++i].toInt (), 1);
+        }
+      else if (arguments[i] == "--temporal-filter")
+        {
+          temporalFilter = true;
+        }
+      else if (arguments[i] == "--publish" && i + 1 < arguments.size ())
+        {
+          publishName = arguments[++i];
+        }
+      else if (arguments[i] == "--publish-udp" && i + 1 < arguments.size ())
+        {
+          publishPort = arguments[++i].toInt ();
+        }
+      else if (arguments[i] == "--publish-unix" && i + 1 < arguments.size ())
+        {
+          publishUnix = arguments[++i];
+        }
+    }
+
+  if (!recordFile.isEmpty () && !m_recorder.open (recordFile.toLocal8Bit ().constData ()))
+    {
+      fprintf (stderr, "Could not create recording %s\n", recordFile.toLocal8Bit ().constData ());
+      exit (1);
+    }
+
+  if (!replayFiles.isEmpty ())
+    {
+      cameraCount = replayFiles.size ();
+    }
+
+  // Recordings should have every frame, live tracking the newest
+  DeliveryPolicy deliveryPolicy = (recordFile.isEmpty () && replayFiles.isEmpty ()) ? DELIVERY_LATEST : DELIVERY_FIFO;
+  if (delivery == "latest")
+    {
+      deliveryPolicy = DELIVERY_LATEST;
+    }
+  else if (delivery == "fifo")
+    {
+      deliveryPolicy = DELIVERY_FIFO;
+    }
+
+  // Every frame in flight needs a slot: one being filled by the source, one
+  // in each stage, the queues in between, the frames waiting to be shown
+  // and the one the preview shows
+  unsigned slots = 3 * queueDepth + 4;
+  if (cameraCount > 1)
+    {
+      slots += queueDepth + 1;
+    }
+
+  m_presentQueue = new FrameQueue (queueDepth);
+  m_fusion = NULL;
+  m_finishedSources = 0;
+
+  std::vector < FrameQueue * >fuseQueues;
+
+  m_cameras.resize (cameraCount);
+  for (unsigned i = 0; i < cameraCount; ++i)
+    {
+      Camera & camera = m_cameras[i];
+      camera.hnd = 0;
+      camera.aquisition = NULL;
+
+      if (!replayFiles.isEmpty ())
+        {
+          ReplayThread *replay = new ReplayThread (slots);
+          if (!replay->open (replayFiles[i].toLocal8Bit ().constData ()))
+            {
+              fprintf (stderr, "Could not open recording %s\n", replayFiles[i].toLocal8Bit ().constData ());
+              exit (1);
+            }
+          replay->setThrottled (throttled);
+          replay->setLoop (loop);
+
+          camera.source = replay;
+
+          // Leave when all recordings are done and tracked, e.g. for runs
+          // on the build machines
+          QObject::connect (camera.source, SIGNAL (finished ()), this, SLOT (sourceFinished ()));
+        }
+      else
+        {
+          camera.aquisition = new AquisitionThread (slots);
+          camera.source = camera.aquisition;
+        }
+      camera.source->setCamera (i);
+      camera.source->setDeliveryPolicy (deliveryPolicy);
+
+      // The first camera uses the tracker of the view
+      camera.tracker = i ? new HeadTracker () : m_pApp->tracker ();
+
+      camera.trackQueue = new FrameQueue (queueDepth);
+      camera.fuseQueue = (cameraCount > 1) ? new FrameQueue (queueDepth) : NULL;
+      if (camera.fuseQueue)
+        {
+          fuseQueues.push_back (camera.fuseQueue);
+        }
+
+      camera.processing = new ProcessingStage (camera.source, camera.trackQueue);
+      camera.processing->setMode (calcMode);
+      if (i == 0 && m_recorder.isOpen ())
+        {
+          camera.processing->setRecorder (&m_recorder);
+        }
+
+      camera.tracking = new TrackingStage (camera.tracker, camera.trackQueue,
+                                           camera.fuseQueue ? camera.fuseQueue : m_presentQueue);
+
+      // Recordings come with their integration time
+      camera.exposure = NULL;
+      if (autoExposure && replayFiles.isEmpty ())
+        {
+          camera.exposure = new ExposureControl ();
+          camera.exposure->setFrameRateTarget (fpsTarget);
+          camera.exposure->setIntegrationTime (m_integrationUs);
+          camera.tracking->setExposureControl (camera.exposure);
+        }
+
+      // Only the first camera is previewed
+      camera.tracking->setPreviewRate (i ? 0 : m_previewRate);
+
+      // Nobody needs the full point cloud when it is not calculated anyway
+      camera.tracker->setFullPointCloud (calcMode != CALC_LAZY);
+      camera.tracker->setDetectionMode (detectionMode);
+      camera.tracker->setMotionModel (motionModel);
+      camera.tracker->setMaxHeads (maxHeads);
+      camera.tracker->setTemporalFilter (temporalFilter);
+
+      // The processing stage sleeps on a semaphore, so wake it from the source
+      // thread instead of going through an event loop
+      QObject::connect (camera.source, SIGNAL (hasNewFrame ()), camera.processing, SLOT (frameAvailable ()),
+                        Qt::DirectConnection);
+    }
 
-  openCam ();
+  if (cameraCount > 1)
+    {
+      m_fusion = new FusionStage (fuseQueues, m_presentQueue);
+      if (!extrinsicsFile.isEmpty () && !m_fusion->fusion ().loadExtrinsics (extrinsicsFile.toLocal8Bit ().constData ()))
+        {
+          fprintf (stderr, "Could not read the extrinsics %s\n", extrinsicsFile.toLocal8Bit ().constData ());
+          exit (1);
+        }
+
+      for (unsigned i = 0; i < cameraCount; ++i)
+        {
+          QObject::connect (m_cameras[i].tracking, SIGNAL (framePassed ()), m_fusion, SLOT (frameAvailable ()),
+                            Qt::DirectConnection);
+        }
+      QObject::connect (m_fusion, SIGNAL (framePassed ()), this, SLOT (presentFrames ()));
+    }
+  else
+    {
+      QObject::connect (m_cameras[0].tracking, SIGNAL (framePassed ()), this, SLOT (presentFrames ()));
+    }
+
+  if (!publishName.isEmpty () && !m_publisher.openShared (publishName.toLocal8Bit ().constData ()))
+    {
+      exit (1);
+    }
+  if (publishPort > 0 && !m_publisher.openUdp (publishPort))
+    {
+      fprintf (stderr, "Could not open UDP port %d\n", publishPort);
+      exit (1);
+    }
+  if (!publishUnix.isEmpty () && !m_publisher.openUnix (publishUnix.toLocal8Bit ().constData ()))
+    {
+      fprintf (stderr, "Could not open Unix socket %s\n", publishUnix.toLocal8Bit ().constData ());
+      exit (1);
+    }
+  if (!publishName.isEmpty () || publishPort > 0 || !publishUnix.isEmpty ())
+    {
+      // The fused pose is the one to publish when there is one
+      if (m_fusion)
+        {
+          m_fusion->setPublisher (&m_publisher);
+        }
+      else
+        {
+          m_cameras[0].tracking->setPublisher (&m_publisher);
+        }
+    }
+
+  m_previewOn = m_previewRate > 0;
+  m_pApp->setPreviewVisible (m_previewOn);
+  if (!m_previewOn)
+    {
+      m_previewRate = 10;
+    }
+
+  if (m_fusion)
+    {
+      m_fusion->start ();
+    }
+  for (unsigned i = 0; i < cameraCount; ++i)
+    {
+      m_cameras[i].tracking->start ();
+      m_cameras[i].processing->start ();
+    }
+
+  if (replayFiles.isEmpty ())
+    {
+      openCam ();
+    }
+  else
+    {
+      for (unsigned i = 0; i < cameraCount; ++i)
+        {
+          m_cameras[i].source->start ();
+        }
+    }
 }
 
 MainWindow::~MainWindow ()
 {
-  m_thread->quit ();
-  while (!m_thread->isFinished ())
+  showPreview (NULL);
+
+  // Stop from the sources downwards, so no stage waits on a stopped one
+  for (size_t i = 0; i < m_cameras.size (); ++i)
     {
+      m_cameras[i].source->stop ();
+      m_cameras[i].source->wait ();
     }
 
-  pmdClose (m_hnd);
+  for (size_t i = 0; i < m_cameras.size (); ++i)
+    {
+      m_cameras[i].processing->stop ();
+      m_cameras[i].processing->wait ();
+    }
+
+  for (size_t i = 0; i < m_cameras.size (); ++i)
+    {
+      m_cameras[i].tracking->stop ();
+      m_cameras[i].tracking->wait ();
+    }
+
+  if (m_fusion)
+    {
+      m_fusion->stop ();
+      m_fusion->wait ();
+      delete m_fusion;
+    }
+
+  for (size_t i = 0; i < m_cameras.size (); ++i)
+    {
+      Camera & camera = m_cameras[i];
+
+      delete camera.tracking;
+      delete camera.processing;
+      delete camera.fuseQueue;
+      delete camera.trackQueue;
+      delete camera.source;
+      delete camera.exposure;
+
+      if (i)
+        {
+          delete camera.tracker;
+        }
+
+      if (camera.hnd)
+        {
+          pmdClose (camera.hnd);
+        }
+    }
+  delete m_presentQueue;
+
+  m_recorder.close ();
+  m_publisher.close ();
 }
 
-void MainWindow::newFrame (PMDDataDescription * dd, void *data)
+void MainWindow::releaseFrame (FrameSlot * slot)
 {
-  ++m_fpsCounter;
+  m_cameras[slot->camera].source->releaseFrame (slot);
+}
 
-  if (m_fpsCounter == 10)
+void MainWindow::presentFrames ()
+{
+  FrameSlot *newest = NULL;
+  FrameSlot *preview = NULL;
+  FrameSlot *slot;
+
+  // Frames that were overtaken while the GUI was busy are not worth
+  // showing, only their slots are needed back. Only some frames carry a
+  // tracking image, so the newest of those is kept for the preview.
+  while ((slot = m_presentQueue->pop (0)) != NULL)
     {
-      m_fpsCounter = 0;
-      statusBar ()->showMessage (QString ("%1 fps").arg (10000.0 / m_lastFrame.elapsed ()));
-      m_lastFrame.restart ();
+      if (newest && newest != preview)
+        {
+          releaseFrame (newest);
+        }
+      if (slot->grayWidth)
+        {
+          if (preview)
+            {
+              releaseFrame (preview);
+            }
+          preview = slot;
+        }
+      newest = slot;
     }
 
-  int res;
-  char err[128];
+  if (!newest)
+    {
+      return;
+    }
 
-  if (m_dataSize != dd->img.numColumns * dd->img.numRows)
+  m_pApp->showFrame (*newest);
+  if (preview)
     {
-      m_dataSize = dd->img.numColumns * dd->img.numRows;
-      delete[]m_pFlags;
-      delete[]m_pAmplitudes;
-      delete[]m_pCoordinates;
+      showPreview (preview);
+    }
+  if (newest != preview)
+    {
+      releaseFrame (newest);
+    }
+}
 
-      m_pFlags = new unsigned[m_dataSize];
-      m_pAmplitudes = new float[m_dataSize];
-      m_pCoordinates = new float[m_dataSize * 3];
+void MainWindow::showPreview (FrameSlot * slot)
+{
+  // The preview holds its frame until the next one replaces it
+  FrameSlot *shown = m_pApp->showPreview (slot);
+  if (shown)
+    {
+      releaseFrame (shown);
     }
+}
 
-  m_pApp->newSourceData (dd, data);
+void MainWindow::sourceFinished ()
+{
+  if (++m_finishedSources == m_cameras.size ())
+    {
+      quitWhenDrained ();
+    }
+}
 
-  res = pmdCalcAmplitudes (m_hnd, m_pAmplitudes, dd->img.numColumns * dd->img.numRows * sizeof (float), *dd, data);
-  if (res != PMD_OK)
+void MainWindow::quitWhenDrained ()
+{
+  // Every frame is back in its pool once it was shown and published, and
+  // the preview let go of it
+  showPreview (NULL);
+
+  for (size_t i = 0; i < m_cameras.size (); ++i)
     {
-      pmdGetLastError (m_hnd, err, 128);
-      fprintf (stderr, "Could not get amplitudes: %s\n", err);
-      exit (1);
+      if (m_cameras[i].source->framesInFlight ())
+        {
+          QTimer::singleShot (s_drainPollMs, this, SLOT (quitWhenDrained ()));
+          return;
+        }
     }
 
-  m_pApp->newAmplitudes (m_pAmplitudes);
+  qApp->quit ();
+}
 
-  res = pmdCalc3DCoordinates (m_hnd, m_pCoordinates, dd->img.numColumns * dd->img.numRows * sizeof (float) * 3, *dd, data);
-  if (res != PMD_OK)
+void MainWindow::updateStatistics ()
+{
+  LatencyStats & stats = LatencyStats::global ();
+  LatencySummary interval, latency;
+
+  stats.summary (STAGE_FRAME_INTERVAL, interval);
+  stats.summary (STAGE_CAPTURE_TO_POSE, latency);
+
+  double fps = (interval.p50 > 0.0) ? 1e6 / interval.p50 : 0.0;
+
+  unsigned dropped = 0;
+  unsigned replaced = 0;
+  for (size_t i = 0; i < m_cameras.size (); ++i)
     {
-      pmdGetLastError (m_hnd, err, 128);
-      fprintf (stderr, "Could not get coordinates: %s\n", err);
-      exit (1);
+      dropped += m_cameras[i].source->droppedFrames ();
+      replaced += m_cameras[i].source->replacedFrames ();
     }
 
-  m_pApp->new3DCoordinates (m_pCoordinates);
+  statusBar ()->showMessage (QString ("%1 fps, %2 frames dropped, %3 replaced, capture to pose %4 ms (p99 %5 ms)")
+                             .arg (fps, 0, 'f', 1)
+                             .arg (dropped).arg (replaced)
+                             .arg (latency.p50 / 1000.0, 0, 'f', 2).arg (latency.p99 / 1000.0, 0, 'f', 2));
 
-  res = pmdCalcFlags (m_hnd, m_pFlags, dd->img.numColumns * dd->img.numRows * sizeof (unsigned), *dd, data);
-  if (res != PMD_OK)
+  if (!m_statsLabel->isVisible ())
     {
-      pmdGetLastError (m_hnd, err, 128);
-      fprintf (stderr, "Could not get flags: %s\n", err);
-      exit (1);
+      return;
     }
 
-  m_pApp->newFlags (m_pFlags);
+  QString text = QString ("%1 %2 %3 %4 %5\n").arg ("stage [us]", -22).arg ("p50", 8).arg ("p95", 8)
+    .arg ("p99", 8).arg ("max", 8);
 
-  m_pApp->finishedFrame ();
+  for (int i = 0; i < STAGE_COUNT; ++i)
+    {
+      LatencySummary s;
+      stats.summary (i, s);
+      if (!s.count)
+        {
+          continue;
+        }
+      text += QString ("%1 %2 %3 %4 %5\n").arg (LatencyStats::stageName (i), -22)
+        .arg (s.p50, 8, 'f', 0).arg (s.p95, 8, 'f', 0).arg (s.p99, 8, 'f', 0).arg (s.max, 8, 'f', 0);
+    }
+
+  m_statsLabel->setText (text.trimmed ());
+  m_statsLabel->adjustSize ();
+  m_statsLabel->raise ();
+}
 
-  m_thread->releaseData (dd, data);
+void MainWindow::toggleOverlay ()
+{
+  m_statsLabel->setVisible (!m_statsLabel->isVisible ());
+  updateStatistics ();
+}
+
+void MainWindow::togglePreview ()
+{
+  m_previewOn = !m_previewOn;
+  m_cameras[0].tracking->setPreviewRate (m_previewOn ? m_previewRate : 0);
+  m_pApp->setPreviewVisible (m_previewOn);
+  if (!m_previewOn)
+    {
+      showPreview (NULL);
+    }
+}
+
+void MainWindow::resetTracking ()
+{
+  for (size_t i = 0; i < m_cameras.size (); ++i)
+    {
+      m_cameras[i].tracker->requestReset ();
+    }
+
+  // The old poses of the other cameras would pull the new ones back
+  if (m_fusion)
+    {
+      m_fusion->requestReset ();
+    }
 }
 
 void MainWindow::openCam ()
@@ -105,56 +595,72 @@ void MainWindow::openCam ()
   int res;
   char err[128];
 
-  res = pmdOpen (&m_hnd, "camboardnano.L32.pap", "", "camboardnanoproc.L32.ppp", "");
-  if (res != PMD_OK)
+  // Every pmdOpen connects to the next camera that is not open yet
+  for (size_t i = 0; i < m_cameras.size (); ++i)
     {
-      pmdGetLastError (0, err, 128);
-      fprintf (stderr, "Could not connect: %s\n", err);
-      exit (1);
-    }
+      Camera & camera = m_cameras[i];
+
+      res = pmdOpen (&camera.hnd, "camboardnano.L32.pap", "", "camboardnanoproc.L32.ppp", "");
+      if (res != PMD_OK)
+        {
+          pmdGetLastError (0, err, 128);
+          fprintf (stderr, "Could not connect camera %d: %s\n", (int) i, err);
+          exit (1);
+        }
 
-  pmdSetIntegrationTime (m_hnd, 0, 500);
+      pmdSetIntegrationTime (camera.hnd, 0, m_integrationUs);
 
-  m_thread->setHandle (m_hnd);
+      camera.aquisition->setHandle (camera.hnd);
+      camera.aquisition->setExposureControl (camera.exposure);
+      camera.processing->setHandle (camera.hnd);
+      camera.tracking->setHandle (camera.hnd);
 
-  m_thread->start ();
+      camera.source->start ();
+    }
 }
 
-AquisitionThread::AquisitionThread ()
+AquisitionThread::AquisitionThread (unsigned slots):FrameSource (slots)
 {
-  m_framesInUse = 0;
   m_hnd = 0;
-  m_timer = 0;
+  m_exposure = NULL;
+  m_stop = 0;
 }
 
 AquisitionThread::~AquisitionThread ()
 {
-  delete m_timer;
   m_hnd = 0;
 }
 
+void AquisitionThread::stop ()
+{
+  m_stop.fetchAndStoreOrdered (1);
+}
+
 void AquisitionThread::setHandle (PMDHandle hnd)
 {
   m_hnd = hnd;
 }
 
+void AquisitionThread::setExposureControl (ExposureControl * exposure)
+{
+  m_exposure = exposure;
+}
+
 void AquisitionThread::run ()
 {
-  if (m_timer)
+  m_stop.fetchAndStoreOrdered (0);
+
+  // pmdUpdate waits for the camera, so the loop runs at the frame rate
+  // without polling
+  while (!m_stop.fetchAndAddAcquire (0))
     {
-      delete m_timer;
+      aquire ();
     }
-
-  m_timer = new QTimer (this);
-  connect (m_timer, SIGNAL (timeout ()), this, SLOT (aquire ()), Qt::DirectConnection);
-  m_timer->setInterval (0);
-  m_timer->start ();
-  exec ();
 }
 
 void AquisitionThread::aquire ()
 {
-  if (m_framesInUse >= 3 || m_hnd <= 0)
+  if (m_hnd <= 0)
     {
       return;
     }
@@ -162,7 +668,18 @@ void AquisitionThread::aquire ()
   int res;
   char err[128];
 
-  res = pmdUpdate (m_hnd);
+  // A queue waits for room before the frame is taken off the camera, so a
+  // recording only loses frames when the processing stalls for long
+  FrameSlot *slot = NULL;
+  if (m_pool.policy () == DELIVERY_FIFO)
+    {
+      slot = m_pool.acquire (s_slotWaitMs);
+    }
+
+  {
+    StageTimer timer (STAGE_UPDATE);
+    res = pmdUpdate (m_hnd);
+  }
   if (res != PMD_OK)
     {
       pmdGetLastError (m_hnd, err, 128);
@@ -171,9 +688,29 @@ void AquisitionThread::aquire ()
       exit (1);
     }
 
-  PMDDataDescription *dd = new PMDDataDescription ();
+  // Always read the frame from the device so the driver never queues stale
+  // data. If the processing thread still holds every slot, drop it here.
+  if (!slot)
+    {
+      slot = m_pool.acquire ();
+    }
+  if (!slot)
+    {
+      m_pool.dropFrame ();
+      return;
+    }
+
+  slot->timestampUs = monotonicMicroseconds ();
+  slot->integrationUs = m_exposure ? m_exposure->integrationTime () : 0;
+
+  // The processing stage calculates the buffers from the source data
+  slot->amplitudes = NULL;
+  slot->coordinates = NULL;
+  slot->flags = NULL;
 
-  res = pmdGetSourceDataDescription (m_hnd, dd);
+  uint64_t start = monotonicNanoseconds ();
+
+  res = pmdGetSourceDataDescription (m_hnd, &slot->dd);
   if (res != PMD_OK)
     {
       pmdGetLastError (m_hnd, err, 128);
@@ -181,7 +718,7 @@ void AquisitionThread::aquire ()
       exit (1);
     }
 
-  if (dd->subHeaderType != PMD_IMAGE_DATA)
+  if (slot->dd.subHeaderType != PMD_IMAGE_DATA)
     {
       printf ("Source data is not an image!\n");
       exit (1);
@@ -190,9 +727,10 @@ void AquisitionThread::aquire ()
   size_t rddsize;
   pmdGetSourceDataSize (m_hnd, &rddsize);
 
-  unsigned char *pmdData = new unsigned char[rddsize];
+  slot->reserve (rddsize);
+  slot->dataSize = rddsize;
 
-  res = pmdGetSourceData (m_hnd, (void *) pmdData, rddsize);
+  res = pmdGetSourceData (m_hnd, (void *) slot->data, rddsize);
   if (res != PMD_OK)
     {
       pmdGetLastError (m_hnd, err, 128);
@@ -200,14 +738,44 @@ void AquisitionThread::aquire ()
       exit (1);
     }
 
-  ++m_framesInUse;
+  LatencyStats::global ().record (STAGE_SOURCE_DATA, monotonicNanoseconds () - start);
 
-  emit hasNewFrame (dd, pmdData);
-}
+  m_pool.publish (slot);
 
-void AquisitionThread::releaseData (PMDDataDescription * dd, void *data)
-{
-  delete dd;
-  delete[](char *) data;
-  --m_framesInUse;
+  emit hasNewFrame ();
+
+  // Between two frames, so the change applies to the next exposure. The
+  // camera only takes some times, the control is told the one it got.
+  unsigned integrationUs;
+  unsigned previous = m_exposure ? m_exposure->integrationTime () : 0;
+  if (m_exposure && m_exposure->update (integrationUs))
+    {
+      unsigned valid;
+      res = pmdGetValidIntegrationTime (m_hnd, &valid, 0, CloseTo, integrationUs);
+      if (res != PMD_OK)
+        {
+          pmdGetLastError (m_hnd, err, 128);
+          printf ("Could not get a valid integration time: %s\n", err);
+          m_exposure->setIntegrationTime (previous);
+          return;
+        }
+
+      // Rounded back to the current time: nothing to set, and the control
+      // must not ask for the same step again
+      if (valid == previous)
+        {
+          m_exposure->rejectUpdate ();
+          return;
+        }
+
+      res = pmdSetIntegrationTime (m_hnd, 0, valid);
+      if (res != PMD_OK)
+        {
+          pmdGetLastError (m_hnd, err, 128);
+          printf ("Could not set the integration time: %s\n", err);
+          m_exposure->setIntegrationTime (previous);
+          return;
+        }
+      m_exposure->setIntegrationTime (valid);
+    }
 }
@@ -5,36 +5,44 @@
 #include <pmdsdk2.h>
 
 #include "headtracking.hpp"
+#include "framesource.hpp"
+#include "framefile.hpp"
+#include "pipeline.hpp"
 
-class AquisitionThread:public QThread
+class AquisitionThread:public FrameSource
 {
 
   Q_OBJECT 
 
 public:
 
-  AquisitionThread ();
+      /** Constructor
+       * \param slots Number of frames that can be in flight at once
+       */
+  AquisitionThread (unsigned slots = 3);
   ~AquisitionThread ();
 
+      /** Read frames until stopped. Sleeps in pmdUpdate until the camera
+       * has the next frame, and with DELIVERY_FIFO also while all slots
+       * are in use. */
   void run ();
+  void stop ();
 
   void setHandle (PMDHandle hnd);
-  void releaseData (PMDDataDescription * dd, void *data);
 
-public slots:
-
-  void aquire ();
-
-signals: 
-
-  void hasNewFrame (PMDDataDescription * dd, void *data);
+      /** Adjust the integration time after every frame, NULL to keep it.
+       * Set before the thread is started. */
+  void setExposureControl (ExposureControl * exposure);
 
 private:
 
+      /** Read one frame from the camera */
+  void aquire ();
+
   PMDHandle m_hnd;
-  QTimer *m_timer;
-  int m_framesInUse;
-  QMutex m_mutex;
+  ExposureControl *m_exposure;
+
+  QAtomicInt m_stop;
 };
 
 class MainWindow:public QMainWindow
@@ -43,35 +51,138 @@ class MainWindow:public QMainWindow
 
 public:
 
-      /** Constructor */
-  MainWindow ();
+      /** Constructor
+       * \param arguments Command line. Understands --replay <file>,
+       * --unthrottled and --loop to play back a recording instead of
+       * opening the camera, --record <file> to record all frames of the
+       * first camera and
+       * --queue-depth <n> to set how many frames may wait between two
+       * pipeline stages. --calc sequential|concurrent|lazy selects how
+       * the buffers are calculated from the camera data, see CalcMode.
+       * --detect depth|haar|guided selects how a new face is found.
+       * --motion velocity|acceleration selects the model of the Kalman
+       * filter. --preview-rate <n> sets how many times per second the
+       * tracking image is shown, 10 by default and 0 for no preview.
+       * --max-heads <n> tracks up to n heads at once instead of one.
+       * --publish <name> publishes every pose in the shared memory
+       * <name>, e.g. /headtracking, see PoseClient. --publish-udp <port>
+       * and --publish-unix <path> also send them as datagrams to a UDP
+       * port on localhost, a Unix socket or both.
+       * --cameras <n> opens n cameras, and --replay given several times
+       * plays back one recording per camera. Every camera is tracked on
+       * its own threads and the poses are fused, in the common
+       * coordinates given by --extrinsics <file>, see
+       * PoseFusion::loadExtrinsics.
+       * --exposure auto|<us> lets an ExposureControl adjust the
+       * integration time of every camera to the amplitude of the head,
+       * the default, or fixes it. --fps-target <n> sets the frame rate
+       * the automatic integration time leaves room for.
+       * --delivery latest|fifo selects how camera frames wait for the
+       * processing, see DeliveryPolicy. By default only the latest frame
+       * is kept, and all frames when recording or playing back.
+       * --temporal-filter averages every pixel over the last frames
+       * before tracking, see HeadTracker::setTemporalFilter.
+       */
+  MainWindow (const QStringList & arguments);
 
       /** Desctructor */
   ~MainWindow ();
 
 public slots:
 
-  void newFrame (PMDDataDescription * dd, void *data);
+      /** Show the newest tracked frame and return all tracked frames to
+       * the frame source, but the one the preview holds */
+  void presentFrames ();
+
+      /** Count a recording that has been played back, and quit once all
+       * are */
+  void sourceFinished ();
+
+      /** Quit as soon as the frames of all cameras are through the
+       * pipeline */
+  void quitWhenDrained ();
+
+      /** Show the latency statistics in the status bar and the overlay */
+  void updateStatistics ();
+
+      /** Show or hide the latency overlay */
+  void toggleOverlay ();
+
+      /** Turn the tracking image preview off or back on */
+  void togglePreview ();
+
+      /** Restart the trackers of all cameras and the fusion of their
+       * poses */
+  void resetTracking ();
 
 private:
 
   void openCam ();
 
-  void startRecognition ();
+      /** Return a frame to the source of its camera */
+  void releaseFrame (FrameSlot * slot);
 
-  unsigned *m_pFlags;
-  float *m_pAmplitudes;
-  float *m_pCoordinates;
-  unsigned m_dataSize;
+      /** Show a frame in the preview, NULL for none, and release the one
+       * it held before */
+  void showPreview (FrameSlot * slot);
+
+  void startRecognition ();
 
   HeadTracking *m_pApp;
 
-  PMDHandle m_hnd;
+      /** Everything that runs once per camera */
+  struct Camera
+  {
+    PMDHandle hnd;
+    FrameSource *source;
+
+        /** The source when it is the camera, NULL for a recording */
+    AquisitionThread *aquisition;
+
+        /** The first camera uses the tracker of m_pApp, the others own
+         * theirs */
+    HeadTracker *tracker;
+
+        /** Queues between processing and tracking, and between tracking
+         * and fusion, the latter NULL with only one camera */
+    FrameQueue *trackQueue;
+    FrameQueue *fuseQueue;
+
+    ProcessingStage *processing;
+    TrackingStage *tracking;
+
+        /** Integration time control, NULL for a fixed time or a
+         * recording */
+    ExposureControl *exposure;
+  };
+
+  std::vector < Camera > m_cameras;
+
+      /** Fuses the poses of the cameras, NULL with only one */
+  FusionStage *m_fusion;
+
+      /** Number of recordings played back to the end */
+  unsigned m_finishedSources;
+
+  FrameRecorder m_recorder;
+
+      /** Hands the poses to other processes, see --publish */
+  PosePublisher m_publisher;
+
+      /** Queue between the last stage and presentation */
+  FrameQueue *m_presentQueue;
+
+  QTimer *m_statsTimer;
+
+      /** Preview rate to go back to when the preview is turned on */
+  int m_previewRate;
+  bool m_previewOn;
 
-  AquisitionThread *m_thread;
+      /** Integration time the cameras start with */
+  unsigned m_integrationUs;
 
-  int m_fpsCounter;
-  QTime m_lastFrame;
+      /** Per stage latency table drawn over the main widget */
+  QLabel *m_statsLabel;
 };
 
 #endif // MAINWINDOW_HPP_984735989
@@ -0,0 +1,471 @@
+#include "pipeline.hpp"
+#include "latencystats.hpp"
+#include "timestamp.hpp"
+
+#include <QtConcurrentRun>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// How long stages sleep at most before they look at their stop flag
+static const int s_pollMs = 50;
+
+// The calculations write to the buffers of the slot and report their own
+// errors, so they can run on any thread
+
+static bool checkResult (PMDHandle hnd, int res, const char *what)
+{
+  if (res != PMD_OK)
+    {
+      char err[128];
+      pmdGetLastError (hnd, err, 128);
+      fprintf (stderr, "Could not get %s: %s\n", what, err);
+      return false;
+    }
+  return true;
+}
+
+static bool calcAmplitudes (PMDHandle hnd, FrameSlot * slot)
+{
+  unsigned pixels = slot->dd.img.numColumns * slot->dd.img.numRows;
+  int res;
+
+  {
+    StageTimer timer (STAGE_CALC_AMPLITUDES);
+    res = pmdCalcAmplitudes (hnd, slot->calcAmplitudes, pixels * sizeof (float), slot->dd, slot->data);
+  }
+  return checkResult (hnd, res, "amplitudes");
+}
+
+static bool calcCoordinates (PMDHandle hnd, FrameSlot * slot)
+{
+  unsigned pixels = slot->dd.img.numColumns * slot->dd.img.numRows;
+  int res;
+
+  {
+    StageTimer timer (STAGE_CALC_COORDINATES);
+    res = pmdCalc3DCoordinates (hnd, slot->calcCoordinates, pixels * sizeof (float) * 3, slot->dd, slot->data);
+  }
+  return checkResult (hnd, res, "coordinates");
+}
+
+static bool calcFlags (PMDHandle hnd, FrameSlot * slot)
+{
+  unsigned pixels = slot->dd.img.numColumns * slot->dd.img.numRows;
+  int res;
+
+  {
+    StageTimer timer (STAGE_CALC_FLAGS);
+    res = pmdCalcFlags (hnd, slot->calcFlags, pixels * sizeof (unsigned), slot->dd, slot->data);
+  }
+  return checkResult (hnd, res, "flags");
+}
+
+FrameQueue::FrameQueue (unsigned depth):m_ring (depth), m_free (depth), m_used (0)
+{
+}
+
+bool FrameQueue::push (FrameSlot * slot, int timeoutMs)
+{
+  if (!m_free.tryAcquire (1, timeoutMs))
+    {
+      return false;
+    }
+
+  m_ring.push (slot);
+  m_used.release ();
+  return true;
+}
+
+FrameSlot *FrameQueue::pop (int timeoutMs)
+{
+  if (!m_used.tryAcquire (1, timeoutMs))
+    {
+      return NULL;
+    }
+
+  FrameSlot *slot = m_ring.pop ();
+  m_free.release ();
+  return slot;
+}
+
+PipelineStage::PipelineStage (FrameQueue * input, FrameQueue * output)
+{
+  m_input = input;
+  m_output = output;
+  m_stop = 0;
+}
+
+void PipelineStage::stop ()
+{
+  m_stop.fetchAndStoreOrdered (1);
+}
+
+FrameSlot *PipelineStage::takeFrame (int timeoutMs)
+{
+  return m_input->pop (timeoutMs);
+}
+
+void PipelineStage::run ()
+{
+  while (!m_stop.fetchAndAddAcquire (0))
+    {
+      FrameSlot *slot = takeFrame (s_pollMs);
+      if (!slot)
+        {
+          continue;
+        }
+
+      processFrame (slot);
+
+      // A full output holds this stage back, which in turn makes the
+      // frame source run out of slots
+      while (!m_output->push (slot, s_pollMs))
+        {
+          if (m_stop.fetchAndAddAcquire (0))
+            {
+              return;
+            }
+        }
+
+      emit framePassed ();
+    }
+}
+
+ProcessingStage::ProcessingStage (FrameSource * source, FrameQueue * output):PipelineStage (NULL, output)
+{
+  m_source = source;
+  m_hnd = 0;
+  m_mode = CALC_SEQUENTIAL;
+  m_recorder = NULL;
+}
+
+void ProcessingStage::setHandle (PMDHandle hnd)
+{
+  m_hnd = hnd;
+}
+
+void ProcessingStage::setMode (CalcMode mode)
+{
+  m_mode = mode;
+}
+
+void ProcessingStage::setRecorder (FrameRecorder * recorder)
+{
+  m_recorder = recorder;
+}
+
+void ProcessingStage::frameAvailable ()
+{
+  m_available.release ();
+}
+
+FrameSlot *ProcessingStage::takeFrame (int timeoutMs)
+{
+  // One release per published frame, so a successful acquire finds a
+  // frame in the source, unless a newer frame replaced it in the mailbox
+  // and was taken with the release before
+  if (!m_available.tryAcquire (1, timeoutMs))
+    {
+      return NULL;
+    }
+
+  return m_source->nextFrame ();
+}
+
+void ProcessingStage::processFrame (FrameSlot * slot)
+{
+  // Recordings come with the buffers already calculated
+  if (!slot->amplitudes)
+    {
+      PMDDataDescription *dd = &slot->dd;
+      bool ok;
+
+      slot->reserveBuffers (dd->img.numColumns * dd->img.numRows);
+
+      CalcMode mode = m_recorder ? CALC_SEQUENTIAL : m_mode;
+
+      switch (mode)
+        {
+          case CALC_CONCURRENT:
+            {
+              QFuture < bool > coords = QtConcurrent::run (calcCoordinates, m_hnd, slot);
+              QFuture < bool > flags = QtConcurrent::run (calcFlags, m_hnd, slot);
+
+              ok = calcAmplitudes (m_hnd, slot);
+              ok = coords.result () && ok;
+              ok = flags.result () && ok;
+            }
+            break;
+          case CALC_LAZY:
+            ok = calcAmplitudes (m_hnd, slot);
+            slot->coordinates = NULL;
+            slot->flags = NULL;
+            break;
+          case CALC_SEQUENTIAL:
+          default:
+            ok = calcAmplitudes (m_hnd, slot) && calcCoordinates (m_hnd, slot) && calcFlags (m_hnd, slot);
+            break;
+        }
+
+      if (!ok)
+        {
+          exit (1);
+        }
+    }
+
+  if (m_recorder)
+    {
+      m_recorder->write (slot->dd, slot->data, slot->dataSize, slot->timestampUs, slot->frameId,
+                         slot->amplitudes, slot->coordinates, slot->flags);
+    }
+}
+
+SlotPointSource::SlotPointSource ()
+{
+  m_hnd = 0;
+  m_slot = NULL;
+  m_started = false;
+}
+
+void SlotPointSource::setHandle (PMDHandle hnd)
+{
+  m_hnd = hnd;
+}
+
+void SlotPointSource::setFrame (FrameSlot * slot)
+{
+  finish ();
+  m_slot = slot;
+}
+
+void SlotPointSource::finish ()
+{
+  if (m_started)
+    {
+      m_pending.waitForFinished ();
+      m_started = false;
+    }
+}
+
+void SlotPointSource::requestPoints ()
+{
+  if (!m_started && m_slot && m_hnd)
+    {
+      m_pending = QtConcurrent::run (this, &SlotPointSource::calculate);
+      m_started = true;
+    }
+}
+
+bool SlotPointSource::points (const float *&coords, const unsigned *&flags)
+{
+  if (!m_slot || !m_hnd)
+    {
+      return false;
+    }
+
+  bool ok = m_started ? m_pending.result () : calculate ();
+  if (!ok)
+    {
+      return false;
+    }
+
+  coords = m_slot->coordinates;
+  flags = m_slot->flags;
+  return true;
+}
+
+bool SlotPointSource::calculate ()
+{
+  if (!m_slot->coordinates)
+    {
+      m_slot->coordinates = m_slot->calcCoordinates;
+      m_slot->flags = m_slot->calcFlags;
+    }
+
+  return calcCoordinates (m_hnd, m_slot) && calcFlags (m_hnd, m_slot);
+}
+
+TrackingStage::TrackingStage (HeadTracker * tracker, FrameQueue * input, FrameQueue * output):PipelineStage (input,
+                                                                                                              output)
+{
+  m_tracker = tracker;
+  m_tracker->setPointSource (&m_points);
+  m_publisher = NULL;
+  m_exposure = NULL;
+  m_lastFrameNs = 0;
+  m_integrationUs = 0;
+  m_previewRate = 10;
+  m_lastPreviewNs = 0;
+}
+
+void TrackingStage::setHandle (PMDHandle hnd)
+{
+  m_points.setHandle (hnd);
+}
+
+void TrackingStage::setPreviewRate (int rate)
+{
+  m_previewRate.fetchAndStoreRelease (qMax (rate, 0));
+}
+
+void TrackingStage::setPublisher (PosePublisher * publisher)
+{
+  m_publisher = publisher;
+}
+
+void TrackingStage::setExposureControl (ExposureControl * exposure)
+{
+  m_exposure = exposure;
+}
+
+void TrackingStage::processFrame (FrameSlot * slot)
+{
+  uint64_t now = monotonicNanoseconds ();
+  if (m_lastFrameNs)
+    {
+      LatencyStats::global ().record (STAGE_FRAME_INTERVAL, now - m_lastFrameNs);
+    }
+  m_lastFrameNs = now;
+
+  m_points.setFrame (slot);
+
+  // The amplitudes change with the integration time, so averages over
+  // frames taken with the old one would mislead the tracking and the
+  // exposure control
+  if (slot->integrationUs != m_integrationUs)
+    {
+      m_tracker->resetTemporalFilter ();
+      m_integrationUs = slot->integrationUs;
+    }
+
+  m_tracker->setFormat (slot->dd.img.numRows, slot->dd.img.numColumns, slot->dd.img.pixelOrigin);
+  m_tracker->process (slot->amplitudes, slot->coordinates, slot->flags, slot->timestampUs, slot->frameId,
+                      slot->pose);
+
+  // Before anything else, other processes are waiting for it
+  if (m_publisher)
+    {
+      const std::vector < TrackedHead > &heads = m_tracker->heads ();
+      if (heads.empty ())
+        {
+          m_publisher->publish (slot->pose);
+        }
+      for (size_t i = 0; i < heads.size (); ++i)
+        {
+          m_publisher->publish (heads[i].pose, heads[i].id);
+        }
+    }
+
+  // Points requested for a face that was not found are still being written
+  m_points.finish ();
+
+  slot->heads = m_tracker->heads ();
+
+  if (m_exposure)
+    {
+      // The flags are only sure to be there around a face
+      const HeadPose & pose = slot->pose;
+      float amplitude = pose.state ?
+        roiAmplitude (m_tracker->amplitudes (), m_tracker->flags (), m_tracker->width (), m_tracker->height (),
+                      pose.faceLeft, pose.faceTop, pose.faceWidth, pose.faceHeight) :
+        roiAmplitude (m_tracker->amplitudes (), NULL, m_tracker->width (), m_tracker->height (),
+                      0, 0, m_tracker->width (), m_tracker->height ());
+      m_exposure->measure (amplitude, slot->integrationUs);
+    }
+
+  LatencyStats::global ().record (STAGE_CAPTURE_TO_POSE, (monotonicMicroseconds () - slot->timestampUs) * 1000);
+
+  slot->grayWidth = 0;
+  slot->grayHeight = 0;
+
+  int rate = m_previewRate.fetchAndAddAcquire (0);
+  if (!rate || (m_lastPreviewNs && now - m_lastPreviewNs < 1000000000ull / rate))
+    {
+      return;
+    }
+  m_lastPreviewNs = now;
+
+  // The tracker reuses its image for the next frame while this one is
+  // still waiting to be shown
+  const Mat & gray = m_tracker->grayImage ();
+
+  slot->reserveGray (gray.cols, gray.rows);
+  for (int y = 0; y < gray.rows; ++y)
+    {
+      memcpy (slot->gray + y * gray.cols, gray.ptr (y), gray.cols);
+    }
+}
+
+FusionStage::FusionStage (const std::vector < FrameQueue * >&inputs,
+                          FrameQueue * output):PipelineStage (NULL, output), m_inputs (inputs), m_fusion (inputs.size ())
+{
+  m_nextInput = 0;
+  m_publisher = NULL;
+  m_resetRequested = 0;
+}
+
+PoseFusion & FusionStage::fusion ()
+{
+  return m_fusion;
+}
+
+void FusionStage::setPublisher (PosePublisher * publisher)
+{
+  m_publisher = publisher;
+}
+
+void FusionStage::frameAvailable ()
+{
+  m_available.release ();
+}
+
+FrameSlot *FusionStage::takeFrame (int timeoutMs)
+{
+  // One release per tracked frame, so a successful acquire always finds a
+  // frame in one of the inputs
+  if (!m_available.tryAcquire (1, timeoutMs))
+    {
+      return NULL;
+    }
+
+  for (size_t i = 0; i < m_inputs.size (); ++i)
+    {
+      unsigned input = m_nextInput;
+      m_nextInput = (m_nextInput + 1) % m_inputs.size ();
+
+      FrameSlot *slot = m_inputs[input]->pop (0);
+      if (slot)
+        {
+          return slot;
+        }
+    }
+
+  return NULL;
+}
+
+void FusionStage::requestReset ()
+{
+  m_resetRequested.fetchAndStoreRelease (1);
+}
+
+void FusionStage::processFrame (FrameSlot * slot)
+{
+  if (m_resetRequested.fetchAndStoreAcquire (0))
+    {
+      m_fusion.reset ();
+    }
+
+  {
+    StageTimer timer (STAGE_FUSION);
+    HeadPose fused;
+    m_fusion.update (slot->camera, slot->pose, fused);
+    slot->pose = fused;
+  }
+
+  if (m_publisher)
+    {
+      m_publisher->publish (slot->pose);
+    }
+}
@@ -0,0 +1,292 @@
+#ifndef PIPELINE_HPP_8830461925
+#define PIPELINE_HPP_8830461925
+
+#include <QThread>
+#include <QSemaphore>
+#include <QFuture>
+#include <pmdsdk2.h>
+
+#include "framepool.hpp"
+#include "framesource.hpp"
+#include "framefile.hpp"
+#include "headtracker.hpp"
+#include "pointsource.hpp"
+#include "posepublisher.hpp"
+#include "posefusion.hpp"
+#include "exposurecontrol.hpp"
+
+/** How the processing stage calculates the buffers of a frame */
+enum CalcMode
+{
+      /** Amplitudes, coordinates and flags one after another */
+  CALC_SEQUENTIAL,
+
+      /** Amplitudes, coordinates and flags at the same time */
+  CALC_CONCURRENT,
+
+      /** Amplitudes only; the tracker gets coordinates and flags from a
+       * SlotPointSource when it found a face */
+  CALC_LAZY
+};
+
+/** Bounded queue of frame slots between two pipeline stages.
+ * The slots travel through a lock-free ring; the two semaphores only put
+ * a stage to sleep while its input is empty or its output is full.
+ */
+class FrameQueue
+{
+public:
+
+      /** Constructor
+       * \param depth Maximum number of frames waiting in the queue
+       */
+  FrameQueue (unsigned depth);
+
+      /** Append a slot, waiting up to timeoutMs for room. Returns false on
+       * timeout. */
+  bool push (FrameSlot * slot, int timeoutMs);
+
+      /** Remove the oldest slot, waiting up to timeoutMs for one. Returns
+       * NULL on timeout. */
+  FrameSlot *pop (int timeoutMs);
+
+private:
+
+  FrameRing m_ring;
+  QSemaphore m_free;
+  QSemaphore m_used;
+};
+
+/** One thread of the processing pipeline.
+ * Takes frames from its input, works on them and passes them on to its
+ * output queue, until stopped.
+ */
+class PipelineStage:public QThread
+{
+
+  Q_OBJECT
+
+public:
+
+      /** Constructor
+       * \param input Queue to take frames from, NULL if takeFrame is
+       * reimplemented
+       * \param output Queue for the processed frames
+       */
+  PipelineStage (FrameQueue * input, FrameQueue * output);
+
+      /** Ask the thread to finish. Use wait () to join it. */
+  void stop ();
+
+  void run ();
+
+signals:
+
+      /** A frame was put into the output queue */
+  void framePassed ();
+
+protected:
+
+      /** Next frame to work on, or NULL if there is none within timeoutMs */
+  virtual FrameSlot *takeFrame (int timeoutMs);
+
+      /** Work on one frame */
+  virtual void processFrame (FrameSlot * slot) = 0;
+
+  FrameQueue *m_input;
+  FrameQueue *m_output;
+
+  QAtomicInt m_stop;
+};
+
+/** Calculates amplitudes, coordinates and flags with the PMD SDK.
+ * Takes its frames directly from the frame source and optionally
+ * records them.
+ */
+class ProcessingStage:public PipelineStage
+{
+
+  Q_OBJECT
+
+public:
+
+  ProcessingStage (FrameSource * source, FrameQueue * output);
+
+  void setHandle (PMDHandle hnd);
+
+      /** Set how the buffers are calculated, CALC_SEQUENTIAL by default.
+       * Recorded frames always get all buffers. */
+  void setMode (CalcMode mode);
+
+      /** Record every processed frame, NULL to stop */
+  void setRecorder (FrameRecorder * recorder);
+
+public slots:
+
+      /** Wakes the stage, connect directly to FrameSource::hasNewFrame */
+  void frameAvailable ();
+
+protected:
+
+  FrameSlot *takeFrame (int timeoutMs);
+  void processFrame (FrameSlot * slot);
+
+private:
+
+  FrameSource *m_source;
+  QSemaphore m_available;
+
+  PMDHandle m_hnd;
+  CalcMode m_mode;
+  FrameRecorder *m_recorder;
+};
+
+/** Calculates the coordinates and flags of a frame slot with the PMD SDK
+ * when the tracker asks for them.
+ * The SDK has no calls for parts of a frame, so the whole frame is
+ * calculated, but only for frames with a face.
+ */
+class SlotPointSource:public PointSource
+{
+public:
+
+  SlotPointSource ();
+
+  void setHandle (PMDHandle hnd);
+
+      /** Frame to calculate the points of. Waits for the previous frame. */
+  void setFrame (FrameSlot * slot);
+
+      /** Wait until the current frame is no longer worked on */
+  void finish ();
+
+  void requestPoints ();
+  bool points (const float *&coords, const unsigned *&flags);
+
+private:
+
+  bool calculate ();
+
+  PMDHandle m_hnd;
+  FrameSlot *m_slot;
+
+      /** Background calculation started by requestPoints */
+  QFuture < bool > m_pending;
+  bool m_started;
+};
+
+/** Runs the tracker on processed frames and attaches the pose to each
+ * frame. A copy of the tracking image is only attached at the preview
+ * rate, so the preview costs next to nothing on the tracking thread.
+ */
+class TrackingStage:public PipelineStage
+{
+
+  Q_OBJECT
+
+public:
+
+  TrackingStage (HeadTracker * tracker, FrameQueue * input, FrameQueue * output);
+
+      /** Handle for calculating the points of frames that come without
+       * them, see CALC_LAZY */
+  void setHandle (PMDHandle hnd);
+
+      /** Attach the tracking image to at most rate frames per second, 0 to
+       * attach it to none. Frames without it have a grayWidth of 0. Can be
+       * called from any thread. */
+  void setPreviewRate (int rate);
+
+      /** Publish the pose of every frame as soon as it is known, NULL for
+       * none. With several heads each is published under its id. Set
+       * before the stage is started. */
+  void setPublisher (PosePublisher * publisher);
+
+      /** Measure the amplitude of the head in every frame for the
+       * integration time control of its camera, NULL for none. Set before
+       * the stage is started. */
+  void setExposureControl (ExposureControl * exposure);
+
+protected:
+
+  void processFrame (FrameSlot * slot);
+
+private:
+
+  HeadTracker *m_tracker;
+  PosePublisher *m_publisher;
+  ExposureControl *m_exposure;
+
+  QAtomicInt m_previewRate;
+
+      /** Time the tracking image was last attached in nanoseconds */
+  uint64_t m_lastPreviewNs;
+
+  SlotPointSource m_points;
+
+      /** Time the last frame was tracked in nanoseconds */
+  uint64_t m_lastFrameNs;
+
+      /** Integration time of the last frame */
+  unsigned m_integrationUs;
+};
+
+/** Fuses the poses of several cameras, see PoseFusion.
+ * Every camera has its own processing and tracking stages, so each scales
+ * on its own cores. Their tracked frames meet here in the order they were
+ * tracked, get the fused pose and go on to one output. Only the pose is
+ * fused; when several heads are tracked, the heads of a frame stay in the
+ * coordinates of its camera.
+ */
+class FusionStage:public PipelineStage
+{
+
+  Q_OBJECT
+
+public:
+
+      /** Constructor
+       * \param inputs Output queue of the tracking stage of every camera,
+       * in the order of the camera numbers
+       * \param output Queue for the frames with the fused pose
+       */
+  FusionStage (const std::vector < FrameQueue * >&inputs, FrameQueue * output);
+
+      /** Extrinsics and settings of the fusion. Only change them before
+       * the stage is started. */
+  PoseFusion & fusion ();
+
+      /** Publish every fused pose, NULL for none. Set before the stage is
+       * started. */
+  void setPublisher (PosePublisher * publisher);
+
+      /** Forget the poses of all cameras before the next frame is fused.
+       * May be called from any thread. */
+  void requestReset ();
+
+public slots:
+
+      /** Wakes the stage, connect directly to TrackingStage::framePassed
+       * of every camera */
+  void frameAvailable ();
+
+protected:
+
+  FrameSlot *takeFrame (int timeoutMs);
+  void processFrame (FrameSlot * slot);
+
+private:
+
+  std::vector < FrameQueue * >m_inputs;
+
+      /** Input to look at first, so no camera is starved */
+  unsigned m_nextInput;
+  QSemaphore m_available;
+
+  PoseFusion m_fusion;
+  PosePublisher *m_publisher;
+
+  QAtomicInt m_resetRequested;
+};
+
+#endif // PIPELINE_HPP_8830461925
@@ -0,0 +1,96 @@
+#include "preview.hpp"
+#include "latencystats.hpp"
+
+// Shared by all preview images, QImage only references it
+static const QVector < QRgb > &grayTable ()
+{
+  static QVector < QRgb > s_table;
+  if (s_table.isEmpty ())
+    {
+      s_table.resize (256);
+      for (int i = 0; i < 256; ++i)
+        {
+          s_table[i] = qRgb (i, i, i);
+        }
+    }
+  return s_table;
+}
+
+// Mark the face of a pose, returns false if it has none
+static bool drawFace (QPainter & painter, const HeadPose & pose)
+{
+  if (!pose.faceWidth || !pose.faceHeight)
+    {
+      return false;
+    }
+
+  painter.setPen ((pose.state == 1) ? Qt::red : Qt::green);
+  painter.drawRect (QRect (pose.faceLeft, pose.faceTop, pose.faceWidth, pose.faceHeight));
+  return true;
+}
+
+QImage previewImage (const FrameSlot & slot)
+{
+  QImage image (slot.gray, slot.grayWidth, slot.grayHeight, slot.grayWidth, QImage::Format_Indexed8);
+  image.setColorTable (grayTable ());
+  return image;
+}
+
+void drawPreview (QPainter & painter, const FrameSlot & slot, const QImage & image)
+{
+  painter.drawImage (0, 0, image);
+
+  if (slot.heads.empty ())
+    {
+      drawFace (painter, slot.pose);
+    }
+
+  for (size_t i = 0; i < slot.heads.size (); ++i)
+    {
+      const HeadPose & head = slot.heads[i].pose;
+      if (drawFace (painter, head))
+        {
+          painter.drawText (head.faceLeft + 2, head.faceTop + 10, QString::number (slot.heads[i].id));
+        }
+    }
+}
+
+PreviewWidget::PreviewWidget (QWidget * parent):QWidget (parent)
+{
+  m_slot = NULL;
+}
+
+FrameSlot *PreviewWidget::setFrame (FrameSlot * slot)
+{
+  FrameSlot *previous = m_slot;
+  QSize size = m_image.size ();
+
+  m_slot = slot;
+  m_image = slot ? previewImage (*slot) : QImage ();
+
+  if (m_image.size () != size)
+    {
+      updateGeometry ();
+    }
+  update ();
+
+  return previous;
+}
+
+QSize PreviewWidget::sizeHint () const
+{
+  return m_image.isNull () ? QSize (0, 0) : m_image.size ();
+}
+
+void PreviewWidget::paintEvent (QPaintEvent *)
+{
+  if (!m_slot)
+    {
+      return;
+    }
+
+  StageTimer timer (STAGE_PREVIEW);
+
+  QPainter painter (this);
+  drawPreview (painter, *m_slot, m_image);
+}
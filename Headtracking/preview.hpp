@@ -0,0 +1,53 @@
+#ifndef PREVIEW_HPP_5830174926
+#define PREVIEW_HPP_5830174926
+
+#include <QWidget>
+#include <QImage>
+#include <QPainter>
+
+#include "framepool.hpp"
+
+/** Tracking image of a frame as an indexed image with a gray color table.
+ * The image shares the gray buffer of the slot, so it is only valid as
+ * long as the slot is held. Nothing is converted or copied.
+ * \param slot Frame with a tracking image, see FrameSlot::gray
+ */
+QImage previewImage (const FrameSlot & slot);
+
+/** Draw the tracking image of a frame at the origin and mark its faces on
+ * top. Needs no display, so it also draws into images.
+ * \param painter Painter to draw with
+ * \param slot Frame the image belongs to
+ * \param image Image of the frame, see previewImage
+ */
+void drawPreview (QPainter & painter, const FrameSlot & slot, const QImage & image);
+
+/** Shows the tracking image of a frame with its faces marked.
+ * The widget holds the frame it shows and paints from its gray buffer
+ * whenever it needs to, until the next frame replaces it.
+ */
+class PreviewWidget:public QWidget
+{
+public:
+
+  PreviewWidget (QWidget * parent = 0);
+
+      /** Show a frame, NULL for none.
+       * \param slot Frame with a tracking image, held until the next call
+       * \return The frame shown before, which can be released now, or NULL
+       */
+  FrameSlot *setFrame (FrameSlot * slot);
+
+  QSize sizeHint () const;
+
+protected:
+
+  void paintEvent (QPaintEvent * event);
+
+private:
+
+  FrameSlot *m_slot;
+  QImage m_image;
+};
+
+#endif // PREVIEW_HPP_5830174926